@@ -25,36 +25,15 @@ async function establishNativeHostConnection() {
   }
 
   return new Promise((resolve, reject) => {
-    // Attempt to connect to the native messaging host
+    // Attempt to connect to the native messaging host; a new host subscribes anew
+    subscribed = false;
     nativeHostPort = chrome.runtime.connectNative('com.chromecast.nativehost.cpp');
 
     // Listen for messages from the native messaging host
     nativeHostPort.onMessage.addListener(async msg => {
-
-      if (msg.request === 'tabInfo') {
-        // Forward the message to the content script of the current tab
-        tabInfoResponse = null
-        try {
-          // Get the response from getTabInfoRequest
-          tabInfoResponse = await getTabInfoRequest();
-        } catch (error) {
-          tabInfoResponse = {error : "fail to message content script"}
-        }
-        
-        // Send the response back to the native host
-        try {
-          await new Promise((resolve, reject) => {
-            nativeHostPort.postMessage({ response: 'tabInfo', data: tabInfoResponse }, () => {
-              if (chrome.runtime.lastError) {
-                reject(new Error(chrome.runtime.lastError.message));
-              } else {
-                resolve();
-              }
-            });
-          });
-        } catch (error) {
-          console.error('Error sending response to native host:', error);
-        }
+      const message = reassembleChunk(msg);
+      if (message) {
+        await handleNativeHostMessage(message);
       }
     });
 
@@ -78,6 +57,208 @@ async function establishNativeHostConnection() {
   });
 }
 
+// Once the host sent {request: 'subscribe'}, it is told whenever the active tab may
+// have changed: another tab or window came to the front, or the active tab
+// navigated or finished loading (its page metadata is only complete then). The
+// host then no longer needs to poll, and drops its cached tabInfo answer.
+let subscribed = false;
+
+function pushTabChanged(reason, tabId, url) {
+  if (subscribed && nativeHostPort) {
+    nativeHostPort.postMessage({ event: 'tabChanged', reason, tabId, url });
+  }
+}
+
+// Content scripts report media playback; the host publishes it to its clients
+chrome.runtime.onMessage.addListener((msg, sender) => {
+  if (msg.event === 'playback' && sender.tab && subscribed && nativeHostPort) {
+    nativeHostPort.postMessage({ ...msg, tabId: sender.tab.id, url: sender.tab.url });
+  }
+});
+
+chrome.tabs.onActivated.addListener(({ tabId }) => {
+  if (subscribed) {
+    chrome.tabs.get(tabId, tab => pushTabChanged('activated', tabId, tab ? tab.url : undefined));
+  }
+});
+chrome.windows.onFocusChanged.addListener(windowId => {
+  if (subscribed && windowId !== chrome.windows.WINDOW_ID_NONE) {
+    chrome.tabs.query({ active: true, windowId }, tabs => {
+      if (tabs && tabs.length > 0) {
+        pushTabChanged('focused', tabs[0].id, tabs[0].url);
+      }
+    });
+  }
+});
+chrome.tabs.onUpdated.addListener((tabId, changeInfo, tab) => {
+  if (tab.active && (changeInfo.url || changeInfo.status === 'complete')) {
+    pushTabChanged('updated', tabId, tab.url);
+  }
+});
+chrome.webNavigation.onCommitted.addListener(details => {
+  if (details.frameId === 0) {
+    pushTabChanged('navigated', details.tabId, details.url);
+  }
+});
+// Single-page sites such as YouTube navigate without a commit
+chrome.webNavigation.onHistoryStateUpdated.addListener(details => {
+  if (details.frameId === 0) {
+    pushTabChanged('navigated', details.tabId, details.url);
+  }
+});
+
+// Requests the host is still waiting for, by id. The host sends {cancel: id} when its
+// client gave up, and every request carries timeoutMs, the time the host will wait.
+const inFlightRequests = new Map();
+
+// Below this budget the content script is not asked for page metadata
+const META_SCRAPE_MIN_BUDGET_MS = 50;
+
+async function handleNativeHostMessage(msg) {
+  if (msg.cancel !== undefined) {
+    const request = inFlightRequests.get(msg.cancel);
+    if (request) {
+      request.cancelled = true;
+    }
+    return;
+  }
+
+  if (msg.request === 'subscribe') {
+    subscribed = true;
+    return;
+  }
+
+  if (msg.request === 'ping') {
+    // Idle heartbeat the host uses to measure round-trip times, answer right away
+    nativeHostPort.postMessage({ response: 'ping', id: msg.id });
+    return;
+  }
+
+  if (Array.isArray(msg.batch)) {
+    await handleBatch(msg.batch);
+    return;
+  }
+
+  if (msg.request === 'tabInfo') {
+    const request = trackRequest(msg);
+
+    // Forward the message to the content script of the current tab
+    let tabInfoResponse = null
+    try {
+      // Get the response from getTabInfoRequest
+      tabInfoResponse = await getTabInfoRequest(request.deadline);
+    } catch (error) {
+      tabInfoResponse = {error : "fail to message content script"}
+    }
+
+    // The host would discard the answer anyway
+    if (!finishRequest(request)) {
+      return;
+    }
+    
+    // Send the response back to the native host
+    // Echo the request id so the host can match replies to pipelined requests
+    await postToNativeHost({ response: 'tabInfo', id: msg.id, data: tabInfoResponse });
+  }
+}
+
+// Requests the host queued together arrive as {batch: [...]}. They share one tabs
+// query and one metadata scrape, bounded by the earliest deadline, and are answered
+// by a single {response: 'batch', batch: [...]} message.
+async function handleBatch(requests) {
+  const tabInfoRequests = requests.filter(msg => msg.request === 'tabInfo').map(trackRequest);
+  if (tabInfoRequests.length === 0) {
+    return;
+  }
+
+  let tabInfoResponse = null
+  try {
+    tabInfoResponse = await getTabInfoRequest(Math.min(...tabInfoRequests.map(request => request.deadline)));
+  } catch (error) {
+    tabInfoResponse = {error : "fail to message content script"}
+  }
+
+  const responses = tabInfoRequests
+    .filter(finishRequest)
+    .map(request => ({ response: 'tabInfo', id: request.id, data: tabInfoResponse }));
+  if (responses.length > 0) {
+    await postToNativeHost({ response: 'batch', batch: responses });
+  }
+}
+
+function trackRequest(msg) {
+  const request = {
+    id: msg.id,
+    cancelled: false,
+    deadline: msg.timeoutMs !== undefined ? Date.now() + msg.timeoutMs : Infinity
+  };
+  inFlightRequests.set(msg.id, request);
+  return request;
+}
+
+// False when nobody waits for the answer any more
+function finishRequest(request) {
+  inFlightRequests.delete(request.id);
+  return !request.cancelled && Date.now() <= request.deadline;
+}
+
+async function postToNativeHost(message) {
+  try {
+    await new Promise((resolve, reject) => {
+      nativeHostPort.postMessage(message, () => {
+        if (chrome.runtime.lastError) {
+          reject(new Error(chrome.runtime.lastError.message));
+        } else {
+          resolve();
+        }
+      });
+    });
+  } catch (error) {
+    console.error('Error sending response to native host:', error);
+  }
+}
+
+// Messages above Chrome's 1 MB native messaging limit arrive as a sequence of
+// {chunk: {id, seq, last | abort}, data} frames, each carrying a slice of the JSON text
+const pendingChunks = new Map();
+
+function reassembleChunk(msg) {
+  if (!msg.chunk) {
+    return msg;
+  }
+
+  const { id, seq, last, abort } = msg.chunk;
+  if (abort) {
+    pendingChunks.delete(id);
+    return null;
+  }
+
+  let parts = pendingChunks.get(id);
+  if (!parts) {
+    parts = [];
+    pendingChunks.set(id, parts);
+  }
+
+  if (seq !== parts.length) {
+    console.error('Dropping chunked message ' + id + ': expected chunk ' + parts.length + ', got ' + seq);
+    pendingChunks.delete(id);
+    return null;
+  }
+
+  parts.push(msg.data);
+  if (!last) {
+    return null;
+  }
+
+  pendingChunks.delete(id);
+  try {
+    return JSON.parse(parts.join(''));
+  } catch (error) {
+    console.error('Error parsing chunked message:', error);
+    return null;
+  }
+}
+
 const siteMap = {  
   "www.youtube.com": "youtube",  
   "www.netflix.com": "netflix"  
@@ -88,7 +269,9 @@ function getTag(url){
   return siteMap[host] || "og";
 }  
 
-async function getTabInfoRequest() {
+// Page metadata comes from the content script, which can be slow; it is skipped
+// or cut short so the answer still makes the deadline
+async function getTabInfoRequest(deadline = Infinity) {
   return new Promise((resolve, reject) => {
     chrome.tabs.query({ active: true, lastFocusedWindow: true }, async tabs => {
       if (tabs && tabs.length > 0) {
@@ -100,6 +283,15 @@ async function getTabInfoRequest() {
                 resolve({error:"empty tab"})
               } else {
                 let tag = getTag(url)              
+                const budget = deadline - Date.now();
+                if (budget < META_SCRAPE_MIN_BUDGET_MS) {
+                  resolve({ url });
+                  return;
+                }
+                if (budget !== Infinity) {
+                  // Leave a little of the budget for the way back to the host
+                  setTimeout(() => resolve({ url }), budget - META_SCRAPE_MIN_BUDGET_MS / 2);
+                }
                 sendMessageToTab(tabs[0].id, { request: "meta", tag })
                 .then(response => {
                   if (response) {
@@ -108,6 +300,7 @@ async function getTabInfoRequest() {
                     resolve({ url });
                   }
                 })
+                .catch(() => resolve({ url }))
               }
           } catch(error) {
             resolve({url:tabs[0].url})
@@ -18,6 +18,24 @@ chrome.runtime.onMessage.addListener((msg, sender, sendResponse) => {
   }
 });
 
+// Media elements starting, pausing or ending playback, for the host's playback
+// topic. Media events do not bubble, so they are caught on the way down.
+for (const state of ['play', 'pause', 'ended']) {
+  document.addEventListener(state, event => {
+    const media = event.target;
+    if (!(media instanceof HTMLMediaElement)) {
+      return;
+    }
+    chrome.runtime.sendMessage({
+      event: 'playback',
+      state,
+      src: media.currentSrc,
+      currentTime: media.currentTime,
+      duration: Number.isFinite(media.duration) ? media.duration : null
+    }).catch(() => {});
+  }, true);
+}
+
 // Example asynchronous operation function
 function fetchMeta(tag) {
   return new Promise((resolve, reject) => {
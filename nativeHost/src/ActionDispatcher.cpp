@@ -0,0 +1,212 @@
+#include "ActionDispatcher.h"
+#include "Logger.hpp"
+
+#include <chrono>
+
+using json = nlohmann::json;
+
+namespace {
+    inline void logError(const std::string& errorMessage) {
+        LOG_TAGGED_ERROR(Logger::LogTag::GENERAL, errorMessage);
+    }
+
+    const char* kindName(ActionDispatcher::HandlerKind kind) {
+        switch (kind) {
+            case ActionDispatcher::HandlerKind::Local:
+                return "local";
+            case ActionDispatcher::HandlerKind::Worker:
+                return "worker";
+            case ActionDispatcher::HandlerKind::Remote:
+            default:
+                return "remote";
+        }
+    }
+
+    std::string batchItemStatus(const json& response) {
+        auto error = response.find("error");
+        if (error == response.end()) {
+            return "ok";
+        }
+        if (*error == "timeout" || *error == "deadline exceeded") {
+            return "timeout";
+        }
+        return "error";
+    }
+
+    SharedMessagePtr errorResponse(const json& request, const std::string& error) {
+        json response;
+        response["action"] = ActionDispatcher::actionOf(request).value_or("");
+        response["data"] = "";
+        response["error"] = error;
+        return makeSharedMessage(std::move(response));
+    }
+}
+
+void ActionDispatcher::registerHandler(const std::string& action, HandlerKind kind, Handler handler) {
+    size_t index = BUILTIN_LOOKUP.find(action);
+    Entry* entry;
+    if (index < BUILTIN_ACTIONS.size()) {
+        entry = &builtinEntries[index];
+    } else {
+        std::lock_guard<std::mutex> lock(entriesMutex);
+        entry = &entries[action];
+    }
+    entry->kind = kind;
+    entry->handler = std::move(handler);
+}
+
+void ActionDispatcher::setExecutor(Executor newExecutor) {
+    executor = std::move(newExecutor);
+}
+
+void ActionDispatcher::setFallbackHandler(HandlerKind kind, Handler handler) {
+    fallback.kind = kind;
+    fallback.handler = std::move(handler);
+}
+
+void ActionDispatcher::dispatch(const json& request, std::shared_ptr<RequestContext> context, Reply reply) {
+    auto action = actionOf(request);
+    if (!action.has_value()) {
+        reply(errorResponse(request, "missing action"));
+        return;
+    }
+    Entry* entry = findEntry(action.value());
+    if (entry == nullptr) {
+        reply(errorResponse(request, "unknown action"));
+        return;
+    }
+    if (dropIfAbandoned(*entry, request, *context, reply)) {
+        return;
+    }
+    if (entry->kind == HandlerKind::Worker && executor) {
+        // Checked again once a worker picks it up: the wait in the queue may have
+        // outlasted the deadline
+        executor([this, entry, request, context = std::move(context), reply = std::move(reply)]() mutable {
+            if (!dropIfAbandoned(*entry, request, *context, reply)) {
+                invoke(*entry, request, context, std::move(reply));
+            }
+        });
+        return;
+    }
+    invoke(*entry, request, context, std::move(reply));
+}
+
+void ActionDispatcher::dispatchBatch(const json& items, const std::vector<std::shared_ptr<RequestContext>>& contexts,
+                                     Reply reply) {
+    auto batch = std::make_shared<PendingBatch>();
+    batch->results = json::array();
+    batch->results.get_ref<json::array_t&>().resize(items.size());
+    batch->remaining = items.size();
+    batch->reply = std::move(reply);
+    if (items.empty()) {
+        batch->reply(makeSharedMessage(std::move(batch->results)));
+        return;
+    }
+
+    for (size_t i = 0; i < items.size(); ++i) {
+        // Missing actions are answered by dispatch() like any other error
+        // Each item becomes part of the batch's own response, so it is copied there
+        dispatch(items[i], contexts[i], [batch, i](SharedMessagePtr response) {
+            json result = response->value();
+            result["status"] = batchItemStatus(result);
+            {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->results[i] = std::move(result);
+                if (--batch->remaining > 0) {
+                    return;
+                }
+            }
+            batch->reply(makeSharedMessage(std::move(batch->results)));
+        });
+    }
+}
+
+std::optional<std::string> ActionDispatcher::actionOf(const json& request) {
+    if (!request.is_object()) {
+        return std::nullopt;
+    }
+    auto action = request.find("action");
+    if (action == request.end() || !action->is_string() || action->get_ref<const std::string&>().empty()) {
+        return std::nullopt;
+    }
+    return action->get<std::string>();
+}
+
+json ActionDispatcher::statistics() {
+    json out = json::object();
+    for (size_t i = 0; i < BUILTIN_ACTIONS.size(); ++i) {
+        appendStatistics(out, std::string(BUILTIN_ACTIONS[i]), builtinEntries[i]);
+    }
+    {
+        std::lock_guard<std::mutex> lock(entriesMutex);
+        for (const auto& entry : entries) {
+            appendStatistics(out, entry.first, entry.second);
+        }
+    }
+    appendStatistics(out, "*", fallback);
+    return out;
+}
+
+ActionDispatcher::Entry* ActionDispatcher::findEntry(const std::string& action) {
+    size_t index = BUILTIN_LOOKUP.find(action);
+    if (index < BUILTIN_ACTIONS.size() && builtinEntries[index].handler) {
+        return &builtinEntries[index];
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(entriesMutex);
+        auto entry = entries.find(action);
+        if (entry != entries.end() && entry->second.handler) {
+            return &entry->second;
+        }
+    }
+
+    return fallback.handler ? &fallback : nullptr;
+}
+
+bool ActionDispatcher::dropIfAbandoned(Entry& entry, const json& request, const RequestContext& context, Reply& reply) {
+    if (context.cancelled()) {
+        reply(errorResponse(request, "cancelled"));
+    } else if (context.expired()) {
+        reply(errorResponse(request, "deadline exceeded"));
+    } else {
+        return false;
+    }
+    entry.stats.dropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Wraps the reply so every completion is counted and timed, whichever thread it
+// happens on
+void ActionDispatcher::invoke(Entry& entry, const json& request, const std::shared_ptr<RequestContext>& context,
+                              Reply reply) {
+    auto started = std::chrono::steady_clock::now();
+    ActionStats& stats = entry.stats;
+    auto timedReply = [&stats, started, reply = std::move(reply)](SharedMessagePtr response) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+        stats.calls.fetch_add(1, std::memory_order_relaxed);
+        stats.totalMicroseconds.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+        reply(std::move(response));
+    };
+
+    try {
+        entry.handler(request, context, timedReply);
+    } catch (const std::exception& ex) {
+        logError("Handler for '" + actionOf(request).value_or("") + "' failed: " + ex.what());
+        timedReply(errorResponse(request, "handler failed"));
+    }
+}
+
+void ActionDispatcher::appendStatistics(json& out, const std::string& action, const Entry& entry) {
+    if (!entry.handler) {
+        return;
+    }
+    uint64_t calls = entry.stats.calls.load(std::memory_order_relaxed);
+    uint64_t total = entry.stats.totalMicroseconds.load(std::memory_order_relaxed);
+    json stats;
+    stats["kind"] = kindName(entry.kind);
+    stats["calls"] = calls;
+    stats["meanMicroseconds"] = calls > 0 ? total / calls : 0;
+    stats["dropped"] = entry.stats.dropped.load(std::memory_order_relaxed);
+    out[action] = stats;
+}
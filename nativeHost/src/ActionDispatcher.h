@@ -0,0 +1,107 @@
+#ifndef ACTION_DISPATCHER_H
+#define ACTION_DISPATCHER_H
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "json.hpp"
+#include "PerfectHash.hpp"
+#include "RequestContext.hpp"
+#include "SharedMessage.hpp"
+
+// Routes pipe requests to handlers by their "action" field. Every handler is
+// completion based: it gets the request and a reply callback, and calls the
+// callback exactly once, either right away (local handlers, answered in-process)
+// or later from another thread (remote handlers, answered by the extension).
+// Requests whose client cancelled them or whose deadline passed are answered with
+// an error instead of reaching their handler.
+class ActionDispatcher {
+public:
+    // The response is immutable and may answer other requests too
+    using Reply = std::function<void(SharedMessagePtr response)>;
+    using Handler = std::function<void(const nlohmann::json& request, const std::shared_ptr<RequestContext>& context,
+                                       Reply reply)>;
+    using Executor = std::function<void(std::function<void()> task)>;
+
+    // Local: cheap, runs inline on the dispatching thread.
+    // Worker: CPU-heavy, runs on the executor so it cannot hold up other requests.
+    // Remote: forwarded to the extension.
+    enum class HandlerKind { Local, Worker, Remote };
+
+    // Where Worker handlers run; without one they run inline like Local handlers
+    void setExecutor(Executor executor);
+
+    // Actions known at compile time; their handlers are found through a perfect
+    // hash instead of a map lookup
+    static constexpr std::array<std::string_view, 3> BUILTIN_ACTIONS = {"ping", "stats", "tabInfo"};
+
+    // Handlers must be registered before the first dispatch()
+    void registerHandler(const std::string& action, HandlerKind kind, Handler handler);
+
+    // Handles actions without a registered handler (none by default: those get an
+    // "unknown action" error)
+    void setFallbackHandler(HandlerKind kind, Handler handler);
+
+    // reply is called exactly once; a request without a string "action" gets a
+    // "missing action" error
+    void dispatch(const nlohmann::json& request, std::shared_ptr<RequestContext> context, Reply reply);
+
+    // Dispatches every item of a batch at once, each with its own context, and calls
+    // reply once with the array of their responses in the same order. Each response
+    // carries "status" ("ok", "timeout" or "error"), so an item that timed out or
+    // failed, or has no string action, does not cost the others their results.
+    void dispatchBatch(const nlohmann::json& items, const std::vector<std::shared_ptr<RequestContext>>& contexts,
+                       Reply reply);
+
+    // The request's "action" if it is an object with a non-empty string there
+    static std::optional<std::string> actionOf(const nlohmann::json& request);
+
+    // Per action: kind, number of calls, mean completion latency and how many
+    // abandoned requests were dropped before running
+    nlohmann::json statistics();
+
+private:
+    struct ActionStats {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> totalMicroseconds{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    // Results of a batch, filled in as its items complete
+    struct PendingBatch {
+        std::mutex mutex;
+        nlohmann::json results;
+        size_t remaining;
+        Reply reply;
+    };
+
+    struct Entry {
+        HandlerKind kind{HandlerKind::Local};
+        Handler handler;
+        ActionStats stats;
+    };
+
+    static constexpr PerfectHash<BUILTIN_ACTIONS.size()> BUILTIN_LOOKUP{BUILTIN_ACTIONS};
+
+    Entry* findEntry(const std::string& action);
+    static bool dropIfAbandoned(Entry& entry, const nlohmann::json& request, const RequestContext& context, Reply& reply);
+    void invoke(Entry& entry, const nlohmann::json& request, const std::shared_ptr<RequestContext>& context, Reply reply);
+    static void appendStatistics(nlohmann::json& out, const std::string& action, const Entry& entry);
+
+    std::array<Entry, BUILTIN_ACTIONS.size()> builtinEntries;
+    std::mutex entriesMutex;
+    std::map<std::string, Entry> entries;   // Registered actions that are not built in
+    Entry fallback;
+    Executor executor;
+};
+
+#endif  // ACTION_DISPATCHER_H
@@ -3,6 +3,8 @@
 #include <condition_variable>
 #include <optional>
 #include <chrono>
+#include <vector>
+#include <cstddef>
 
 template <typename T>
 class ConcurrentQueue {
@@ -67,6 +69,18 @@ public:
         }
     }
 
+    // Pop up to maxCount values that are immediately available (non-blocking),
+    // taking the lock only once
+    std::vector<T> popBatch(std::size_t maxCount) {
+        std::vector<T> values;
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!queue_.empty() && values.size() < maxCount) {
+            values.push_back(std::move(queue_.front()));
+            queue_.pop();
+        }
+        return values;
+    }
+
     void notifyAll() {
         {
             std::lock_guard<std::mutex> lock(mutex_);
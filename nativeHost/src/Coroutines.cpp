@@ -0,0 +1,161 @@
+#include "Coroutines.h"
+#include "Logger.hpp"
+
+namespace {
+    inline void logError(const std::string& errorMessage) {
+        LOG_TAGGED_ERROR(Logger::LogTag::GENERAL, errorMessage);
+    }
+
+    // Owns itself: starts eagerly and frees its frame when the body ends
+    struct DetachedTask {
+        struct promise_type {
+            DetachedTask get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept {
+                try {
+                    std::rethrow_exception(std::current_exception());
+                } catch (const std::exception& ex) {
+                    logError("Spawned coroutine failed: " + std::string(ex.what()));
+                } catch (...) {
+                    logError("Spawned coroutine failed");
+                }
+            }
+        };
+    };
+
+    DetachedTask runDetached(EventLoop& loop, Task<void> task) {
+        co_await loop.schedule();
+        co_await std::move(task);
+    }
+}
+
+void EventLoop::run() {
+    std::vector<std::coroutine_handle<>> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopRequested && ready.empty()) {
+                if (timers.empty()) {
+                    condition.wait(lock);
+                } else if (condition.wait_until(lock, timers.top().deadline) == std::cv_status::timeout) {
+                    break;
+                }
+            }
+            if (stopRequested) {
+                return;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            while (!timers.empty() && timers.top().deadline <= now) {
+                ready.push_back(timers.top().handle);
+                timers.pop();
+            }
+            batch.assign(ready.begin(), ready.end());
+            ready.clear();
+        }
+
+        for (auto handle : batch) {
+            handle.resume();
+        }
+    }
+}
+
+void EventLoop::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    condition.notify_all();
+}
+
+void EventLoop::post(std::coroutine_handle<> handle) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(handle);
+    }
+    condition.notify_one();
+}
+
+void EventLoop::postAt(std::chrono::steady_clock::time_point deadline, std::coroutine_handle<> handle) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        timers.push(Timer{deadline, nextTimerSequence++, handle});
+    }
+    condition.notify_one();
+}
+
+void EventLoop::spawn(Task<void> task) {
+    runDetached(*this, std::move(task));
+}
+
+AsyncPipeServer::AsyncPipeServer(EventLoop& loop, PipeServer& server)
+    : loop(loop), server(server), reader(&AsyncPipeServer::readLoop, this) {}
+
+AsyncPipeServer::~AsyncPipeServer() {
+    stop();
+}
+
+void AsyncPipeServer::stop() {
+    stopRequested = true;
+    if (reader.joinable()) {
+        reader.join();
+    }
+
+    std::deque<Waiter> stranded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stranded.swap(waiters);
+    }
+    for (auto& waiter : stranded) {
+        loop.post(waiter.handle);
+    }
+}
+
+bool AsyncPipeServer::tryTake(std::optional<PipeRequest>& slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (requests.empty()) {
+        return stopRequested;
+    }
+    slot = std::move(requests.front());
+    requests.pop_front();
+    return true;
+}
+
+// Returns false (resume at once) if a request arrived since await_ready
+bool AsyncPipeServer::wait(std::coroutine_handle<> handle, std::optional<PipeRequest>& slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!requests.empty()) {
+        slot = std::move(requests.front());
+        requests.pop_front();
+        return false;
+    }
+    if (stopRequested) {
+        return false;
+    }
+    waiters.push_back(Waiter{handle, &slot});
+    return true;
+}
+
+void AsyncPipeServer::readLoop() {
+    while (!stopRequested) {
+        auto request = server.readRequest(READ_TIMEOUT_MILLISECONDS);
+        if (!request.has_value()) {
+            continue;
+        }
+
+        std::optional<Waiter> waiter;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (waiters.empty()) {
+                requests.push_back(std::move(request.value()));
+                continue;
+            }
+            waiter = waiters.front();
+            waiters.pop_front();
+            *waiter->slot = std::move(request.value());
+        }
+        loop.post(waiter->handle);
+    }
+}
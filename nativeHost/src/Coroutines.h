@@ -0,0 +1,312 @@
+#ifndef COROUTINES_H
+#define COROUTINES_H
+
+// C++20 coroutine front end for NativeMessagingHost and PipeServer, built only with
+// -Dcoroutines=true. The blocking C++17 API stays available alongside it.
+//
+//   Task<void> handle(EventLoop& loop, AsyncHost& host, PipeServer& server, PipeRequest request) {
+//       auto tabInfo = co_await host.request("tabInfo", std::chrono::milliseconds(500));
+//       co_await loop.sleepFor(std::chrono::milliseconds(10));
+//       server.sendResponse(request.clientId, request.requestId, {{"data", std::string(tabInfo.text())}});
+//   }
+//
+//   Task<void> serve(EventLoop& loop, AsyncHost& host, AsyncPipeServer& pipe, PipeServer& server) {
+//       while (auto request = co_await pipe.nextRequest()) {
+//           loop.spawn(handle(loop, host, server, std::move(request.value())));
+//       }
+//   }
+//
+// Every coroutine is resumed on the thread running EventLoop::run(), so thousands of
+// logical requests share that thread plus the host's own I/O threads.
+
+#if __cplusplus < 202002L
+#error "Coroutines.h needs C++20, configure with -Dcoroutines=true"
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <atomic>
+
+#include "NativeMessagingHost.h"
+#include "PipeServer.h"
+
+template <typename T = void>
+class Task;
+
+namespace coroutine_detail {
+    struct TaskPromiseBase {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        // Lazy: the body starts when the task is awaited
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                auto continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    template <typename Promise>
+    class TaskBase {
+    public:
+        TaskBase() = default;
+        explicit TaskBase(std::coroutine_handle<Promise> handle) : handle(handle) {}
+        TaskBase(TaskBase&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        TaskBase& operator=(TaskBase&& other) noexcept {
+            if (this != &other) {
+                destroy();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+        ~TaskBase() { destroy(); }
+
+        bool await_ready() const noexcept { return !handle || handle.done(); }
+
+        // Symmetric transfer: run the task right away, resume the awaiter when it ends
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+            handle.promise().continuation = awaiter;
+            return handle;
+        }
+
+    protected:
+        void rethrowIfFailed() {
+            if (handle.promise().exception) {
+                std::rethrow_exception(handle.promise().exception);
+            }
+        }
+
+        std::coroutine_handle<Promise> handle;
+
+    private:
+        void destroy() {
+            if (handle) {
+                handle.destroy();
+                handle = nullptr;
+            }
+        }
+    };
+
+    template <typename T>
+    struct TaskPromise : TaskPromiseBase {
+        std::optional<T> value;
+
+        Task<T> get_return_object();
+        void return_value(T result) { value = std::move(result); }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase {
+        Task<void> get_return_object();
+        void return_void() {}
+    };
+}
+
+// Awaitable result of a coroutine; exceptions propagate to the awaiter
+template <typename T>
+class Task : public coroutine_detail::TaskBase<coroutine_detail::TaskPromise<T>> {
+public:
+    using promise_type = coroutine_detail::TaskPromise<T>;
+    using coroutine_detail::TaskBase<promise_type>::TaskBase;
+
+    T await_resume() {
+        this->rethrowIfFailed();
+        return std::move(*this->handle.promise().value);
+    }
+};
+
+template <>
+class Task<void> : public coroutine_detail::TaskBase<coroutine_detail::TaskPromise<void>> {
+public:
+    using promise_type = coroutine_detail::TaskPromise<void>;
+    using coroutine_detail::TaskBase<promise_type>::TaskBase;
+
+    void await_resume() {
+        rethrowIfFailed();
+    }
+};
+
+namespace coroutine_detail {
+    template <typename T>
+    Task<T> TaskPromise<T>::get_return_object() {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+}
+
+// Single-threaded executor: resumes posted coroutines and expired sleeps in order,
+// on the thread that calls run()
+class EventLoop {
+public:
+    // Until stop(); coroutines still suspended at that point are not resumed
+    void run();
+    void stop();
+
+    // Thread-safe: resume handle on the loop thread
+    void post(std::coroutine_handle<> handle);
+
+    // Starts task on the loop thread and lets it run to completion on its own;
+    // an exception escaping it is logged
+    void spawn(Task<void> task);
+
+    // co_await loop.schedule() continues on the loop thread
+    auto schedule() {
+        struct Awaiter {
+            EventLoop& loop;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { loop.post(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    auto sleepFor(std::chrono::steady_clock::duration duration) {
+        struct Awaiter {
+            EventLoop& loop;
+            std::chrono::steady_clock::time_point deadline;
+            bool await_ready() const noexcept { return deadline <= std::chrono::steady_clock::now(); }
+            void await_suspend(std::coroutine_handle<> handle) { loop.postAt(deadline, handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, std::chrono::steady_clock::now() + duration};
+    }
+
+private:
+    struct Timer {
+        std::chrono::steady_clock::time_point deadline;
+        uint64_t sequence;   // Keeps timers with the same deadline in order
+        std::coroutine_handle<> handle;
+
+        bool operator>(const Timer& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    void postAt(std::chrono::steady_clock::time_point deadline, std::coroutine_handle<> handle);
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::coroutine_handle<>> ready;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    uint64_t nextTimerSequence{0};
+    bool stopRequested{false};
+};
+
+struct ExtensionResponse {
+    NativeMessagingHost::ResponseStatus status;
+    MessageSlice data;   // The extension's answer when status is Ok
+
+    std::string_view text() const { return data.view(); }
+};
+
+// Awaitable requests to the extension on top of the pipelined NativeMessagingHost API
+class AsyncHost {
+public:
+    AsyncHost(EventLoop& loop, NativeMessagingHost& host) : loop(loop), host(host) {}
+
+    auto request(std::string request, std::chrono::milliseconds timeout) {
+        struct Awaiter {
+            EventLoop& loop;
+            NativeMessagingHost& host;
+            std::string request;
+            std::chrono::milliseconds timeout;
+            ExtensionResponse result{NativeMessagingHost::ResponseStatus::Timeout, MessageSlice()};
+
+            bool await_ready() const noexcept { return false; }
+
+            // The completion may run on another thread before this returns, so
+            // nothing here touches the awaiter after sendRequest
+            void await_suspend(std::coroutine_handle<> handle) {
+                try {
+                    host.sendRequest(request, timeout,
+                                     [this, handle](NativeMessagingHost::ResponseStatus status, const MessageSlice& response) {
+                                         result = ExtensionResponse{status, response};
+                                         loop.post(handle);
+                                     });
+                } catch (const ChromeDisconnectedError&) {
+                    result = ExtensionResponse{NativeMessagingHost::ResponseStatus::Disconnected, MessageSlice()};
+                    loop.post(handle);
+                }
+            }
+
+            ExtensionResponse await_resume() { return std::move(result); }
+        };
+        return Awaiter{loop, host, std::move(request), timeout};
+    }
+
+private:
+    EventLoop& loop;
+    NativeMessagingHost& host;
+};
+
+// Awaitable PipeServer reads. A background thread pulls requests off the server and
+// hands each to the oldest waiting coroutine, or keeps it until one asks.
+class AsyncPipeServer {
+public:
+    AsyncPipeServer(EventLoop& loop, PipeServer& server);
+    ~AsyncPipeServer();
+
+    // Resumes waiting coroutines with std::nullopt and stops reading
+    void stop();
+
+    // std::nullopt once stop() was called
+    auto nextRequest() {
+        struct Awaiter {
+            AsyncPipeServer& source;
+            std::optional<PipeRequest> result;
+
+            bool await_ready() { return source.tryTake(result); }
+            bool await_suspend(std::coroutine_handle<> handle) { return source.wait(handle, result); }
+            std::optional<PipeRequest> await_resume() { return std::move(result); }
+        };
+        return Awaiter{*this, std::nullopt};
+    }
+
+private:
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        std::optional<PipeRequest>* slot;
+    };
+
+    bool tryTake(std::optional<PipeRequest>& slot);
+    bool wait(std::coroutine_handle<> handle, std::optional<PipeRequest>& slot);
+    void readLoop();
+
+    static constexpr std::chrono::milliseconds READ_TIMEOUT_MILLISECONDS = std::chrono::milliseconds(200);
+
+    EventLoop& loop;
+    PipeServer& server;
+    std::mutex mutex;
+    std::deque<PipeRequest> requests;
+    std::deque<Waiter> waiters;
+    std::atomic_bool stopRequested{false};
+    std::thread reader;
+};
+
+#endif  // COROUTINES_H
@@ -0,0 +1,392 @@
+#include "DualFifoPipeServer.h"
+#include "Logger.hpp"
+#include "json.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+namespace {
+    inline void logError(const std::string& errorMessage) {
+        LOG_TAGGED_ERROR(Logger::LogTag::PIPE_SERVER, errorMessage);
+    }
+
+    inline void logInfo(const std::string& infoMessage) {
+        LOG_TAGGED_INFO(Logger::LogTag::PIPE_SERVER, infoMessage);
+    }
+
+    // epoll tokens: client request FIFOs use the client id, response FIFOs the client
+    // id with RESPONSE_TOKEN_BIT set
+    constexpr uint64_t HANDSHAKE_TOKEN = 0;
+    constexpr uint64_t WAKEUP_TOKEN = UINT64_MAX;
+    constexpr uint64_t RESPONSE_TOKEN_BIT = uint64_t(1) << 62;
+
+    constexpr int EPOLL_WAIT_TIMEOUT_MILLISECONDS = 1000;
+    constexpr int MAX_EPOLL_EVENTS = 64;
+    constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+    // A client that lets this much output pile up is considered stalled and dropped
+    constexpr size_t MAX_PENDING_OUTPUT = 8 * 1024 * 1024;
+
+    std::string errnoString() {
+        return std::string(strerror(errno));
+    }
+
+    void createFifo(const std::string& path) {
+        if (unlink(path.c_str()) == -1 && errno != ENOENT) {
+            throw std::runtime_error("Error unlinking existing named pipe '" + path + "': " + errnoString());
+        }
+        if (mkfifo(path.c_str(), 0666) == -1) {
+            throw std::runtime_error("Error creating named pipe '" + path + "': " + errnoString());
+        }
+        // mkfifo honours the umask, clients may run as other users
+        chmod(path.c_str(), 0666);
+    }
+}
+
+DualFifoPipeServer::DualFifoPipeServer(const std::string& pipeName, size_t pipeBufferSize)
+    : pipeName(pipeName), handshakePath(pipeName + ".req"), pipeBufferSize(pipeBufferSize) {}
+
+DualFifoPipeServer::~DualFifoPipeServer() {
+    try {
+        stop();
+    } catch (const std::exception& ex) {
+        logError("Exception: " + std::string(ex.what()));
+    }
+}
+
+void DualFifoPipeServer::start() {
+    createFifo(handshakePath);
+
+    // O_RDWR keeps a writer around, so the handshake FIFO never reports EOF between clients
+    handshakeFd = open(handshakePath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (handshakeFd == -1) {
+        throw std::runtime_error("Error opening named pipe '" + handshakePath + "': " + errnoString());
+    }
+    setPipeBufferSize(handshakeFd);
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || wakeupFd == -1) {
+        throw std::runtime_error("Error creating epoll/eventfd: " + errnoString());
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = HANDSHAKE_TOKEN;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, handshakeFd, &event);
+    event.data.u64 = WAKEUP_TOKEN;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event);
+
+    logInfo("Waiting for handshakes on '" + handshakePath + "'");
+}
+
+void DualFifoPipeServer::stop() {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    while (!connections.empty()) {
+        closeClientLocked(connections.begin()->first);
+    }
+    closedClients.clear();
+
+    for (int* fd : {&handshakeFd, &epollFd, &wakeupFd}) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+
+    if (unlink(handshakePath.c_str()) == -1 && errno != ENOENT) {
+        throw std::runtime_error("Error unlinking named pipe '" + handshakePath + "': " + errnoString());
+    }
+}
+
+std::vector<PipeClientData> DualFifoPipeServer::readData() {
+    std::vector<PipeClientData> result;
+    if (epollFd == -1) {
+        return result;
+    }
+
+    epoll_event events[MAX_EPOLL_EVENTS];
+    int count = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, EPOLL_WAIT_TIMEOUT_MILLISECONDS);
+    if (count == -1) {
+        if (errno == EINTR) {
+            return result;
+        }
+        throw std::runtime_error("Error waiting on named pipes '" + pipeName + "': " + errnoString());
+    }
+
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    for (PipeClientId client : closedClients) {
+        result.push_back(PipeClientData{PipeClientData::Kind::Disconnected, client, std::string()});
+    }
+    closedClients.clear();
+    for (int i = 0; i < count; ++i) {
+        uint64_t token = events[i].data.u64;
+
+        if (token == WAKEUP_TOKEN) {
+            eventfd_t value;
+            eventfd_read(wakeupFd, &value);
+            continue;
+        }
+
+        if (token == HANDSHAKE_TOKEN) {
+            readHandshakes(result);
+            continue;
+        }
+
+        PipeClientId client = token & ~RESPONSE_TOKEN_BIT;
+        auto connection = connections.find(client);
+        if (connection == connections.end()) {
+            continue;
+        }
+
+        if (token & RESPONSE_TOKEN_BIT) {
+            flushClient(client, connection->second);
+        } else {
+            readClient(client, result);
+        }
+    }
+
+    // Clients dropped by writeData for not reading their responses
+    for (auto connection = connections.begin(); connection != connections.end();) {
+        PipeClientId client = connection->first;
+        ++connection;
+        if (connections.at(client).pendingOutput.size() > MAX_PENDING_OUTPUT) {
+            logError("Client " + std::to_string(client) + " is not reading, dropping it");
+            closeClientLocked(client);
+            result.push_back(PipeClientData{PipeClientData::Kind::Disconnected, client, std::string()});
+        }
+    }
+    return result;
+}
+
+void DualFifoPipeServer::writeData(PipeClientId client, std::initializer_list<PipeBuffer> buffers) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    auto connection = connections.find(client);
+    if (connection == connections.end()) {
+        return;
+    }
+
+    auto& pending = connection->second.pendingOutput;
+    if (pending.size() > MAX_PENDING_OUTPUT) {
+        return;   // Already marked for dropping
+    }
+
+    for (const auto& buffer : buffers) {
+        pending.push(buffer);
+    }
+    flushClient(client, connection->second);
+    if (pending.size() > MAX_PENDING_OUTPUT) {
+        // Let the epoll loop close it and report the disconnect
+        wakeup();
+    }
+}
+
+void DualFifoPipeServer::closeClient(PipeClientId client) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    if (connections.count(client) == 0) {
+        return;
+    }
+    closeClientLocked(client);
+    closedClients.push_back(client);
+    wakeup();
+}
+
+size_t DualFifoPipeServer::outputBacklog(PipeClientId client) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    auto connection = connections.find(client);
+    return connection != connections.end() ? connection->second.pendingOutput.size() : 0;
+}
+
+void DualFifoPipeServer::wakeup() {
+    if (wakeupFd != -1) {
+        eventfd_write(wakeupFd, 1);
+    }
+}
+
+void DualFifoPipeServer::readHandshakes(std::vector<PipeClientData>& events) {
+    char buffer[4096];
+    while (true) {
+        ssize_t bytesRead = read(handshakeFd, buffer, sizeof(buffer));
+        if (bytesRead == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            break;
+        }
+        handshakeDecoder.feed(buffer, static_cast<size_t>(bytesRead));
+    }
+
+    try {
+        while (auto frame = handshakeDecoder.next()) {
+            if (frame->header.type != PipeMessageType::Handshake) {
+                logError("Ignoring non-handshake frame on '" + handshakePath + "'");
+                continue;
+            }
+
+            long pid = 0;
+            try {
+                pid = json::parse(frame->payload).value("pid", 0L);
+            } catch (const json::exception& ex) {
+                logError("Malformed handshake: " + std::string(ex.what()));
+            }
+
+            if (pid <= 0) {
+                logError("Handshake without a valid pid");
+                continue;
+            }
+
+            try {
+                openClient(pid, events);
+            } catch (const std::exception& ex) {
+                logError("Exception: " + std::string(ex.what()));
+            }
+        }
+    } catch (const PipeProtocolError& ex) {
+        logError("Protocol error on '" + handshakePath + "': " + ex.what());
+        handshakeDecoder.reset();
+    }
+}
+
+void DualFifoPipeServer::openClient(long pid, std::vector<PipeClientData>& events) {
+    std::string prefix = pipeName + "." + std::to_string(pid);
+    std::string requestPath = prefix + ".req";
+    std::string responsePath = prefix + ".resp";
+
+    // A new handshake from the same pid replaces its previous session
+    for (auto& [client, connection] : connections) {
+        if (connection.requestPath == requestPath) {
+            PipeClientId previous = client;
+            closeClientLocked(previous);
+            events.push_back(PipeClientData{PipeClientData::Kind::Disconnected, previous, std::string()});
+            break;
+        }
+    }
+
+    createFifo(requestPath);
+    createFifo(responsePath);
+
+    // The request FIFO reports neither data nor hangup until the client opens it.
+    // The response FIFO is opened O_RDWR so this does not have to wait for the
+    // client's read end; the server never reads from it.
+    int requestFd = open(requestPath.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    int responseFd = open(responsePath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (requestFd == -1 || responseFd == -1) {
+        std::string error = errnoString();
+        if (requestFd != -1) close(requestFd);
+        if (responseFd != -1) close(responseFd);
+        unlink(requestPath.c_str());
+        unlink(responsePath.c_str());
+        throw std::runtime_error("Error opening named pipes '" + prefix + "': " + error);
+    }
+
+    setPipeBufferSize(requestFd);
+    setPipeBufferSize(responseFd);
+
+    PipeClientId client = nextClientId++;
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = client;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, requestFd, &event);
+    event.events = 0;
+    event.data.u64 = client | RESPONSE_TOKEN_BIT;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, responseFd, &event);
+
+    connections.emplace(client, Connection{requestFd, responseFd, requestPath, responsePath, PipeOutputQueue(), false});
+    events.push_back(PipeClientData{PipeClientData::Kind::Connected, client, std::string()});
+    logInfo("Client " + std::to_string(client) + " connected on '" + prefix + ".{req,resp}'");
+}
+
+void DualFifoPipeServer::readClient(PipeClientId client, std::vector<PipeClientData>& events) {
+    int fd = connections.at(client).requestFd;
+    std::string bytes;
+    bool closed = false;
+
+    while (true) {
+        size_t offset = bytes.size();
+        bytes.resize(offset + READ_BUFFER_SIZE);
+        ssize_t bytesRead = read(fd, &bytes[offset], READ_BUFFER_SIZE);
+
+        if (bytesRead > 0) {
+            bytes.resize(offset + static_cast<size_t>(bytesRead));
+            continue;
+        }
+
+        bytes.resize(offset);
+        if (bytesRead == -1 && errno == EINTR) {
+            continue;
+        }
+        // 0 means the client closed its write end
+        closed = bytesRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+
+    if (!bytes.empty()) {
+        events.push_back(PipeClientData{PipeClientData::Kind::Data, client, std::move(bytes)});
+    }
+
+    if (closed) {
+        closeClientLocked(client);
+        events.push_back(PipeClientData{PipeClientData::Kind::Disconnected, client, std::string()});
+    }
+}
+
+void DualFifoPipeServer::flushClient(PipeClientId client, Connection& connection) {
+    auto& pending = connection.pendingOutput;
+
+    while (!pending.empty()) {
+        iovec iov[PipeOutputQueue::MAX_IOVECS];
+        int count = pending.fill(iov, PipeOutputQueue::MAX_IOVECS);
+        ssize_t bytesWritten = writev(connection.responseFd, iov, count);
+        if (bytesWritten == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                logError("Error writing to client " + std::to_string(client) + ": " + errnoString());
+            }
+            break;
+        }
+        pending.consume(static_cast<size_t>(bytesWritten));
+    }
+
+    bool wantWrite = !pending.empty();
+    if (wantWrite != connection.writeArmed) {
+        epoll_event event{};
+        event.events = wantWrite ? static_cast<uint32_t>(EPOLLOUT) : 0u;
+        event.data.u64 = client | RESPONSE_TOKEN_BIT;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.responseFd, &event);
+        connection.writeArmed = wantWrite;
+    }
+}
+
+void DualFifoPipeServer::closeClientLocked(PipeClientId client) {
+    auto connection = connections.find(client);
+    if (connection == connections.end()) {
+        return;
+    }
+    close(connection->second.requestFd);
+    close(connection->second.responseFd);
+    unlink(connection->second.requestPath.c_str());
+    unlink(connection->second.responsePath.c_str());
+    connections.erase(connection);
+}
+
+void DualFifoPipeServer::setPipeBufferSize(int fd) {
+    if (pipeBufferSize == 0) {
+        return;
+    }
+    // Capped by /proc/sys/fs/pipe-max-size for unprivileged processes
+    if (fcntl(fd, F_SETPIPE_SZ, static_cast<int>(pipeBufferSize)) == -1) {
+        logError("Error setting pipe buffer size to " + std::to_string(pipeBufferSize) + ": " + errnoString());
+    }
+}
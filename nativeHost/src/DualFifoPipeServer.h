@@ -0,0 +1,70 @@
+#ifndef DUAL_FIFO_PIPE_SERVER_H
+#define DUAL_FIFO_PIPE_SERVER_H
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "PipeServerInterface.h"
+#include "PipeProtocol.hpp"
+
+// PipeServerInterface for clients that can only speak FIFOs, without the single
+// shared FIFO's problems (the server reading back its own responses, requests and
+// responses contending for one kernel buffer).
+//
+// A client announces itself by writing a Handshake frame {"pid":<pid>} to
+// `<name>.req`. The server then creates a private pair of FIFOs for it:
+//   <name>.<pid>.req   client writes requests, server reads
+//   <name>.<pid>.resp  server writes responses, client reads
+// The client opens both (retrying while they do not exist yet) and from then on
+// speaks the normal framed protocol on them. Closing `<name>.<pid>.req` ends the
+// session and the server removes both FIFOs.
+class DualFifoPipeServer : public PipeServerInterface {
+public:
+    // pipeBufferSize is requested with F_SETPIPE_SZ on every FIFO (0 keeps the kernel default)
+    DualFifoPipeServer(const std::string& pipeName, size_t pipeBufferSize);
+    ~DualFifoPipeServer() override;
+
+    void start() override;
+    void stop() override;
+    std::vector<PipeClientData> readData() override;
+    void writeData(PipeClientId client, std::initializer_list<PipeBuffer> buffers) override;
+    void closeClient(PipeClientId client) override;
+    size_t outputBacklog(PipeClientId client) override;
+    void wakeup() override;
+
+private:
+    struct Connection {
+        int requestFd;
+        int responseFd;
+        std::string requestPath;
+        std::string responsePath;
+        PipeOutputQueue pendingOutput;   // Bytes the response FIFO did not accept yet
+        bool writeArmed;             // EPOLLOUT registered on responseFd
+    };
+
+    void readHandshakes(std::vector<PipeClientData>& events);
+    void openClient(long pid, std::vector<PipeClientData>& events);
+    void readClient(PipeClientId client, std::vector<PipeClientData>& events);
+    void flushClient(PipeClientId client, Connection& connection);
+    void closeClientLocked(PipeClientId client);
+    void setPipeBufferSize(int fd);
+
+    DualFifoPipeServer(const DualFifoPipeServer&) = delete;
+    DualFifoPipeServer& operator=(const DualFifoPipeServer&) = delete;
+
+    std::string pipeName;
+    std::string handshakePath;
+    size_t pipeBufferSize;
+    int handshakeFd{-1};
+    int epollFd{-1};
+    int wakeupFd{-1};
+    PipeFrameDecoder handshakeDecoder;
+    PipeClientId nextClientId{1};
+    std::mutex connectionsMutex;
+    std::map<PipeClientId, Connection> connections;
+    // Dropped by closeClient, reported as disconnected by the next readData
+    std::vector<PipeClientId> closedClients;
+};
+
+#endif  // DUAL_FIFO_PIPE_SERVER_H
@@ -0,0 +1,30 @@
+#ifndef EXTENSION_ANSWER_H
+#define EXTENSION_ANSWER_H
+
+#include <optional>
+#include <string>
+
+#include "json.hpp"
+
+// What the extension itself answered to a request forwarded by the host. The pipe
+// response is {"action","data":"<extension frame>"} with a top-level "error" when the
+// round trip failed; the frame is {"response","id","data":{...}} whose "data" carries
+// an "error" of its own when the extension could not answer, e.g. without an active
+// tab. Returns that inner data object only if both levels succeeded.
+inline std::optional<nlohmann::json> extensionAnswer(const nlohmann::json& response) {
+    if (!response.is_object() || response.contains("error")) {
+        return std::nullopt;
+    }
+    auto data = response.find("data");
+    if (data == response.end() || !data->is_string()) {
+        return std::nullopt;
+    }
+
+    nlohmann::json frame = nlohmann::json::parse(data->get_ref<const std::string&>(), nullptr, false);
+    if (!frame.is_object() || !frame.contains("data") || !frame["data"].is_object() || frame["data"].contains("error")) {
+        return std::nullopt;
+    }
+    return std::move(frame["data"]);
+}
+
+#endif  // EXTENSION_ANSWER_H
@@ -0,0 +1,753 @@
+#include "IoUringPipeServer.h"
+#include "UnixSocketPipeServer.h"
+#include "Logger.hpp"
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// Multishot recv and cancel-any arrived with the 6.0 headers
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ASYNC_CANCEL_ANY)
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+    inline void logError(const std::string& errorMessage) {
+        LOG_TAGGED_ERROR(Logger::LogTag::PIPE_SERVER, errorMessage);
+    }
+
+    inline void logInfo(const std::string& infoMessage) {
+        LOG_TAGGED_INFO(Logger::LogTag::PIPE_SERVER, infoMessage);
+    }
+
+    constexpr unsigned RING_ENTRIES = 256;
+    // Room for a completion per client and operation without overflowing
+    constexpr unsigned COMPLETION_ENTRIES = 4096;
+    // Provided buffers shared by every connection's multishot recv
+    constexpr uint16_t BUFFER_GROUP_ID = 0;
+    constexpr unsigned BUFFER_COUNT = 256;
+    constexpr size_t BUFFER_SIZE = 16 * 1024;
+    constexpr std::chrono::nanoseconds WAIT_TIMEOUT = std::chrono::seconds(1);
+    constexpr std::chrono::nanoseconds PROBE_TIMEOUT = std::chrono::milliseconds(100);
+    // How long stop() waits for the kernel to finish with cancelled operations
+    constexpr std::chrono::nanoseconds STOP_TIMEOUT = std::chrono::milliseconds(100);
+    constexpr int STOP_ATTEMPTS = 20;
+    // A client that lets this much output pile up is considered stalled and dropped
+    constexpr size_t MAX_PENDING_OUTPUT = 8 * 1024 * 1024;
+
+    // user_data layout: operation in the top byte, client id (or 0) below it
+    enum class Operation : uint64_t {
+        Accept = 1,
+        Wakeup = 2,
+        Receive = 3,
+        Send = 4,
+        Cancel = 5,
+        Provide = 6,
+    };
+    constexpr int OPERATION_SHIFT = 56;
+    constexpr uint64_t CLIENT_MASK = (uint64_t(1) << OPERATION_SHIFT) - 1;
+
+    uint64_t makeUserData(Operation operation, PipeClientId client) {
+        return (static_cast<uint64_t>(operation) << OPERATION_SHIFT) | (client & CLIENT_MASK);
+    }
+
+    std::string errnoString(int error) {
+        return std::string(strerror(error));
+    }
+
+    // The indices shared with the kernel are plain integers in the mapped ring;
+    // these are the orderings liburing uses on them
+    unsigned loadAcquire(const unsigned* index) {
+        return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+    }
+
+    template <typename T>
+    void storeRelease(T* index, T value) {
+        __atomic_store_n(index, value, __ATOMIC_RELEASE);
+    }
+
+    // Just the parts of io_uring this transport uses, on the raw system calls. Only
+    // the thread driving the transport touches it.
+    class Ring {
+    public:
+        Ring(unsigned entries, unsigned completionEntries) {
+            io_uring_params params{};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = completionEntries;
+            fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd < 0) {
+                throw std::runtime_error("Error creating io_uring: " + errnoString(errno));
+            }
+            // One mapping for both rings (5.4), waits with a timeout (5.11), operations
+            // that complete silently (5.17)
+            unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+            if ((params.features & required) != required) {
+                release();
+                throw std::runtime_error("io_uring lacks features this transport needs");
+            }
+
+            ringSize = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            void* ringMemory = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                    IORING_OFF_SQ_RING);
+            void* sqeMemory = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                   IORING_OFF_SQES);
+            rings = ringMemory == MAP_FAILED ? nullptr : static_cast<char*>(ringMemory);
+            sqes = sqeMemory == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqeMemory);
+            if (rings == nullptr || sqes == nullptr) {
+                int error = errno;
+                release();
+                throw std::runtime_error("Error mapping io_uring: " + errnoString(error));
+            }
+
+            sqHead = reinterpret_cast<unsigned*>(rings + params.sq_off.head);
+            sqTail = reinterpret_cast<unsigned*>(rings + params.sq_off.tail);
+            sqMask = *reinterpret_cast<unsigned*>(rings + params.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned*>(rings + params.sq_off.array);
+            sqEntries = params.sq_entries;
+            cqHead = reinterpret_cast<unsigned*>(rings + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(rings + params.cq_off.tail);
+            cqMask = *reinterpret_cast<unsigned*>(rings + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(rings + params.cq_off.cqes);
+            localTail = *sqTail;
+        }
+
+        ~Ring() {
+            release();
+        }
+
+        // A zeroed entry to fill in; submits what is queued first if the queue is full
+        io_uring_sqe* getSqe() {
+            while (localTail - loadAcquire(sqHead) >= sqEntries) {
+                int result = enter(false, std::chrono::nanoseconds(0));
+                if (result < 0 && result != -EINTR) {
+                    throw std::runtime_error("Error submitting to io_uring: " + errnoString(-result));
+                }
+            }
+            unsigned index = localTail & sqMask;
+            sqArray[index] = index;
+            ++localTail;
+            std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+            return &sqes[index];
+        }
+
+        // Submits every entry filled in since the last call and, with wait, blocks
+        // until at least one completion is ready or timeout passes. Returns a
+        // negative errno on failure.
+        int enter(bool wait, std::chrono::nanoseconds timeout) {
+            storeRelease(sqTail, localTail);
+            unsigned toSubmit = localTail - loadAcquire(sqHead);
+            if (toSubmit == 0 && !wait) {
+                return 0;
+            }
+
+            __kernel_timespec waitTime{};
+            waitTime.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(timeout).count();
+            waitTime.tv_nsec = (timeout % std::chrono::seconds(1)).count();
+            io_uring_getevents_arg argument{};
+            argument.ts = reinterpret_cast<uint64_t>(&waitTime);
+            unsigned flags = wait ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+            long result = syscall(__NR_io_uring_enter, fd, toSubmit, wait ? 1 : 0, flags,
+                                  wait ? &argument : nullptr, wait ? sizeof(argument) : 0);
+            return result < 0 ? -errno : static_cast<int>(result);
+        }
+
+        // Hands every ready completion to handle, then returns their slots
+        template <typename Handler>
+        void forEachCompletion(Handler handle) {
+            unsigned head = *cqHead;
+            unsigned tail = loadAcquire(cqTail);
+            for (; head != tail; ++head) {
+                handle(cqes[head & cqMask]);
+            }
+            storeRelease(cqHead, head);
+        }
+
+    private:
+        void release() {
+            if (sqes != nullptr) {
+                munmap(sqes, sqesSize);
+                sqes = nullptr;
+            }
+            if (rings != nullptr) {
+                munmap(rings, ringSize);
+                rings = nullptr;
+            }
+            if (fd != -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        Ring(const Ring&) = delete;
+        Ring& operator=(const Ring&) = delete;
+
+        int fd{-1};
+        char* rings{nullptr};
+        size_t ringSize{0};
+        io_uring_sqe* sqes{nullptr};
+        size_t sqesSize{0};
+        unsigned* sqHead{nullptr};
+        unsigned* sqTail{nullptr};
+        unsigned* sqArray{nullptr};
+        unsigned sqMask{0};
+        unsigned sqEntries{0};
+        unsigned localTail{0};   // Entries handed out by getSqe, published by enter
+        unsigned* cqHead{nullptr};
+        unsigned* cqTail{nullptr};
+        unsigned cqMask{0};
+        io_uring_cqe* cqes{nullptr};
+    };
+
+    // Receive buffers handed to the kernel as one provided buffer group: every
+    // multishot recv completion names the buffer the kernel filled, which goes back
+    // to the group once its bytes are copied out. Handing buffers back rides along
+    // with the next submission and posts no completion unless it fails.
+    //
+    // Buffer rings (IORING_REGISTER_PBUF_RING) would save those submissions, but
+    // receives into them fail with ENOBUFS on some kernels that accept the
+    // registration, and a transport that silently reads nothing is worse than one
+    // that costs a few submission entries.
+    class ProvidedBuffers {
+    public:
+        ProvidedBuffers(Ring& ring, unsigned count, size_t size, uint16_t group)
+            : ring(ring), size(size), group(group), memory(count * size) {
+            provide(0, count);
+        }
+
+        const char* data(unsigned id) const {
+            return &memory[id * size];
+        }
+
+        // Queues buffer id for reuse; the kernel gets it with the next publish()
+        void recycle(unsigned id) {
+            recycled.push_back(id);
+        }
+
+        // One provide operation per run of consecutive buffer ids
+        void publish() {
+            std::sort(recycled.begin(), recycled.end());
+            for (size_t first = 0; first < recycled.size();) {
+                size_t last = first + 1;
+                while (last < recycled.size() && recycled[last] == recycled[last - 1] + 1) {
+                    ++last;
+                }
+                provide(recycled[first], static_cast<unsigned>(last - first));
+                first = last;
+            }
+            recycled.clear();
+        }
+
+    private:
+        void provide(unsigned firstId, unsigned count) {
+            io_uring_sqe* sqe = ring.getSqe();
+            sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+            sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+            sqe->fd = static_cast<int>(count);
+            sqe->addr = reinterpret_cast<uint64_t>(&memory[firstId * size]);
+            sqe->len = static_cast<uint32_t>(size);
+            sqe->off = firstId;
+            sqe->buf_group = group;
+            sqe->user_data = makeUserData(Operation::Provide, 0);
+        }
+
+        ProvidedBuffers(const ProvidedBuffers&) = delete;
+        ProvidedBuffers& operator=(const ProvidedBuffers&) = delete;
+
+        Ring& ring;
+        size_t size;
+        uint16_t group;
+        std::vector<char> memory;
+        std::vector<unsigned> recycled;
+    };
+
+    // Multishot recv into provided buffers (6.0) is the newest feature used. Kernels
+    // without it only reject it per request, so one real receive is tried on a
+    // socket pair rather than trusting the release number.
+    bool multishotReceiveWorks() {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+            return false;
+        }
+
+        bool works = false;
+        try {
+            Ring ring(4, 8);
+            ProvidedBuffers buffers(ring, 1, 1, BUFFER_GROUP_ID);
+            io_uring_sqe* sqe = ring.getSqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = fds[0];
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = BUFFER_GROUP_ID;
+            sqe->user_data = makeUserData(Operation::Receive, 0);
+            if (write(fds[1], "x", 1) == 1 && ring.enter(true, PROBE_TIMEOUT) >= 0) {
+                ring.forEachCompletion([&works](const io_uring_cqe& cqe) {
+                    works = works || (cqe.res == 1 && (cqe.flags & IORING_CQE_F_BUFFER) != 0);
+                });
+            }
+        } catch (const std::exception&) {
+            works = false;
+        }
+
+        close(fds[0]);
+        close(fds[1]);
+        return works;
+    }
+}
+
+class IoUringPipeServer : public PipeServerInterface {
+public:
+    explicit IoUringPipeServer(const std::string& socketPath) : socketPath(socketPath) {}
+
+    ~IoUringPipeServer() override {
+        try {
+            stop();
+        } catch (const std::exception& ex) {
+            logError("Exception: " + std::string(ex.what()));
+        }
+    }
+
+    // True if the running kernel supports everything this transport relies on
+    static bool isSupported() {
+        static const bool supported = multishotReceiveWorks();
+        return supported;
+    }
+
+    void start() override {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("Socket path too long: '" + socketPath + "'");
+        }
+        std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+        if (unlink(socketPath.c_str()) == -1 && errno != ENOENT) {
+            throw std::runtime_error("Error unlinking existing socket '" + socketPath + "': " + errnoString(errno));
+        }
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd == -1) {
+            throw std::runtime_error("Error creating socket: " + errnoString(errno));
+        }
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+            throw std::runtime_error("Error binding socket '" + socketPath + "': " + errnoString(errno));
+        }
+        // Same access rights the FIFO transport grants
+        chmod(socketPath.c_str(), 0666);
+        if (listen(listenFd, SOMAXCONN) == -1) {
+            throw std::runtime_error("Error listening on socket '" + socketPath + "': " + errnoString(errno));
+        }
+
+        wakeupFd = eventfd(0, EFD_CLOEXEC);
+        if (wakeupFd == -1) {
+            throw std::runtime_error("Error creating eventfd: " + errnoString(errno));
+        }
+
+        ring = std::make_unique<Ring>(RING_ENTRIES, COMPLETION_ENTRIES);
+        buffers = std::make_unique<ProvidedBuffers>(*ring, BUFFER_COUNT, BUFFER_SIZE, BUFFER_GROUP_ID);
+        stopping = false;
+        armAccept();
+        armWakeup();
+        ring->enter(false, std::chrono::nanoseconds(0));
+
+        logInfo("Listening on '" + socketPath + "' (io_uring)");
+    }
+
+    void stop() override {
+        if (ring) {
+            drainRing();
+            buffers.reset();
+            ring.reset();
+            outstanding = 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            for (auto& connection : connections) {
+                close(connection.second.fd);
+            }
+            connections.clear();
+            sendsPending = false;
+        }
+
+        for (int* fd : {&listenFd, &wakeupFd}) {
+            if (*fd != -1) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+
+        if (unlink(socketPath.c_str()) == -1 && errno != ENOENT) {
+            throw std::runtime_error("Error unlinking socket '" + socketPath + "': " + errnoString(errno));
+        }
+    }
+
+    // The only place the ring is driven: submits the queued sends together with the
+    // re-armed operations in one io_uring_enter, then turns the completions into
+    // events
+    std::vector<PipeClientData> readData() override {
+        std::vector<PipeClientData> result;
+        if (!ring) {
+            return result;
+        }
+
+        queueSends();
+        int waitResult = ring->enter(true, WAIT_TIMEOUT);
+        if (waitResult < 0 && waitResult != -ETIME && waitResult != -EINTR) {
+            throw std::runtime_error("Error waiting on io_uring for '" + socketPath + "': " + errnoString(-waitResult));
+        }
+        processCompletions(result);
+        return result;
+    }
+
+    // Called from the send thread: only queues the buffers, readData() submits them
+    void writeData(PipeClientId client, std::initializer_list<PipeBuffer> data) override {
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            auto connection = connections.find(client);
+            if (connection == connections.end() || connection->second.closing) {
+                return;
+            }
+
+            auto& state = connection->second;
+            size_t size = 0;
+            for (const auto& buffer : data) {
+                size += buffer->size();
+            }
+            if (state.pendingOutput.size() + size > MAX_PENDING_OUTPUT) {
+                logError("Client " + std::to_string(client) + " is not reading, dropping it");
+                // Ends the multishot recv, whose completion reports the disconnect
+                state.closing = true;
+                shutdown(state.fd, SHUT_RDWR);
+                return;
+            }
+
+            for (const auto& buffer : data) {
+                state.pendingOutput.push(buffer);
+            }
+            // One wakeup per batch: later writes ride along until the loop submits them
+            wake = !sendsPending;
+            sendsPending = true;
+        }
+        if (wake) {
+            wakeup();
+        }
+    }
+
+    void closeClient(PipeClientId client) override {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        auto connection = connections.find(client);
+        if (connection != connections.end() && !connection->second.closing) {
+            connection->second.closing = true;
+            // Ends the multishot recv; the connection is released once nothing references it
+            shutdown(connection->second.fd, SHUT_RDWR);
+        }
+    }
+
+    size_t outputBacklog(PipeClientId client) override {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        auto connection = connections.find(client);
+        return connection != connections.end() ? connection->second.pendingOutput.size() : 0;
+    }
+
+    void wakeup() override {
+        if (wakeupFd != -1) {
+            eventfd_write(wakeupFd, 1);
+        }
+    }
+
+private:
+    struct Connection {
+        int fd{-1};
+        // Queued by writeData; while a send is in flight the kernel reads the front
+        // buffers through iov, which stay valid however many are appended meanwhile
+        PipeOutputQueue pendingOutput;
+        iovec iov[PipeOutputQueue::MAX_IOVECS];
+        msghdr message{};
+        bool receiving{false};
+        bool sending{false};
+        bool closing{false};
+        bool reported{false};       // Disconnected event already emitted
+    };
+
+    using ConnectionIterator = std::map<PipeClientId, Connection>::iterator;
+
+    // An entry for an operation whose completion the loop waits for
+    io_uring_sqe* getSqe(Operation operation, PipeClientId client) {
+        io_uring_sqe* sqe = ring->getSqe();
+        sqe->user_data = makeUserData(operation, client);
+        ++outstanding;
+        return sqe;
+    }
+
+    void armAccept() {
+        io_uring_sqe* sqe = getSqe(Operation::Accept, 0);
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listenFd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+    }
+
+    void armWakeup() {
+        io_uring_sqe* sqe = getSqe(Operation::Wakeup, 0);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wakeupFd;
+        sqe->addr = reinterpret_cast<uint64_t>(&wakeupValue);
+        sqe->len = sizeof(wakeupValue);
+    }
+
+    void armReceive(PipeClientId client, Connection& connection) {
+        io_uring_sqe* sqe = getSqe(Operation::Receive, client);
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = connection.fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP_ID;
+        connection.receiving = true;
+    }
+
+    // One sendmsg over as many queued buffers as fit, without copying them
+    void armSend(PipeClientId client, Connection& connection) {
+        connection.message = msghdr{};
+        connection.message.msg_iov = connection.iov;
+        connection.message.msg_iovlen = static_cast<size_t>(
+            connection.pendingOutput.fill(connection.iov, PipeOutputQueue::MAX_IOVECS));
+        io_uring_sqe* sqe = getSqe(Operation::Send, client);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = connection.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&connection.message);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        connection.sending = true;
+    }
+
+    // Every connection with queued output and no send in flight gets a send
+    void queueSends() {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        if (!sendsPending) {
+            return;
+        }
+        sendsPending = false;
+        for (auto& [client, connection] : connections) {
+            if (!connection.closing && !connection.sending && !connection.pendingOutput.empty()) {
+                armSend(client, connection);
+            }
+        }
+    }
+
+    void processCompletions(std::vector<PipeClientData>& events) {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        ring->forEachCompletion([this, &events](const io_uring_cqe& cqe) { handleCompletion(cqe, events); });
+        buffers->publish();
+    }
+
+    void handleCompletion(const io_uring_cqe& cqe, std::vector<PipeClientData>& events) {
+        auto operation = static_cast<Operation>(cqe.user_data >> OPERATION_SHIFT);
+        PipeClientId client = cqe.user_data & CLIENT_MASK;
+        bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+        if (!more && operation != Operation::Cancel && operation != Operation::Provide) {
+            --outstanding;
+        }
+
+        switch (operation) {
+            case Operation::Accept:
+                if (cqe.res >= 0) {
+                    openClient(cqe.res, events);
+                } else if (cqe.res != -ECANCELED && !stopping) {
+                    logError("Error accepting client: " + errnoString(-cqe.res));
+                }
+                if (!more && !stopping) {
+                    armAccept();
+                }
+                break;
+
+            case Operation::Wakeup:
+                if (!stopping) {
+                    armWakeup();
+                }
+                break;
+
+            case Operation::Receive:
+                handleReceive(client, cqe, more, events);
+                break;
+
+            case Operation::Send:
+                handleSend(client, cqe, events);
+                break;
+
+            case Operation::Provide:
+                // Only failures post a completion; the buffers stay out of use
+                logError("Error providing receive buffers: " + errnoString(-cqe.res));
+                break;
+
+            case Operation::Cancel:
+                break;
+        }
+    }
+
+    void handleReceive(PipeClientId client, const io_uring_cqe& cqe, bool more, std::vector<PipeClientData>& events) {
+        auto connection = connections.find(client);
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            unsigned id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            if (cqe.res > 0 && connection != connections.end() && !stopping) {
+                events.push_back(PipeClientData{PipeClientData::Kind::Data, client,
+                                                std::string(buffers->data(id), static_cast<size_t>(cqe.res))});
+            }
+            buffers->recycle(id);
+        }
+        if (connection == connections.end() || more) {
+            return;
+        }
+
+        auto& state = connection->second;
+        state.receiving = false;
+        // Multishot stops on its own now and then, e.g. while every buffer is taken
+        if ((cqe.res > 0 || cqe.res == -ENOBUFS) && !state.closing && !stopping) {
+            armReceive(client, state);
+            return;
+        }
+        state.closing = true;
+        releaseIfIdle(connection, events);
+    }
+
+    void handleSend(PipeClientId client, const io_uring_cqe& cqe, std::vector<PipeClientData>& events) {
+        auto connection = connections.find(client);
+        if (connection == connections.end()) {
+            return;
+        }
+        auto& state = connection->second;
+        state.sending = false;
+        if (cqe.res < 0) {
+            if (cqe.res != -EPIPE && cqe.res != -ECONNRESET && !stopping) {
+                logError("Error writing to client " + std::to_string(client) + ": " + errnoString(-cqe.res));
+            }
+            state.pendingOutput.clear();
+            state.closing = true;
+            shutdown(state.fd, SHUT_RDWR);
+        } else {
+            state.pendingOutput.consume(static_cast<size_t>(cqe.res));
+            if (!state.pendingOutput.empty() && !state.closing && !stopping) {
+                armSend(client, state);
+            }
+        }
+        releaseIfIdle(connection, events);
+    }
+
+    void openClient(int fd, std::vector<PipeClientData>& events) {
+        if (stopping) {
+            close(fd);
+            return;
+        }
+        PipeClientId client = nextClientId++;
+        auto& connection = connections[client];
+        connection.fd = fd;
+        armReceive(client, connection);
+        events.push_back(PipeClientData{PipeClientData::Kind::Connected, client, std::string()});
+    }
+
+    // A closing connection is reported once and freed when the kernel holds no
+    // references to its socket or buffers any more
+    void releaseIfIdle(ConnectionIterator connection, std::vector<PipeClientData>& events) {
+        auto& state = connection->second;
+        if (!state.closing) {
+            return;
+        }
+        if (!state.reported) {
+            state.reported = true;
+            events.push_back(PipeClientData{PipeClientData::Kind::Disconnected, connection->first, std::string()});
+        }
+        if (state.receiving) {
+            shutdown(state.fd, SHUT_RDWR);
+            return;
+        }
+        if (state.sending) {
+            return;
+        }
+        close(state.fd);
+        connections.erase(connection);
+    }
+
+    // Cancels everything in flight and waits until the kernel reported every
+    // operation finished, so no completion can write into buffers freed after it
+    void drainRing() {
+        stopping = true;
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            io_uring_sqe* sqe = getSqe(Operation::Cancel, 0);
+            --outstanding;   // Its own completion is not waited for
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+        }
+
+        std::vector<PipeClientData> ignored;
+        for (int attempt = 0; attempt < STOP_ATTEMPTS && outstanding > 0; ++attempt) {
+            ring->enter(true, STOP_TIMEOUT);
+            processCompletions(ignored);
+        }
+        if (outstanding > 0) {
+            logError(std::to_string(outstanding) + " io_uring operations still pending at stop");
+        }
+    }
+
+    IoUringPipeServer(const IoUringPipeServer&) = delete;
+    IoUringPipeServer& operator=(const IoUringPipeServer&) = delete;
+
+    std::string socketPath;
+    std::unique_ptr<Ring> ring;
+    std::unique_ptr<ProvidedBuffers> buffers;   // Destroyed before ring
+    int listenFd{-1};
+    int wakeupFd{-1};
+    eventfd_t wakeupValue{0};
+    size_t outstanding{0};   // Operations the kernel may still complete, receive thread only
+    bool stopping{false};
+    PipeClientId nextClientId{1};
+    std::mutex connectionsMutex;
+    std::map<PipeClientId, Connection> connections;
+    bool sendsPending{false};
+};
+
+std::unique_ptr<PipeServerInterface> createIoUringPipeServer(const std::string& socketPath) {
+    if (IoUringPipeServer::isSupported()) {
+        return std::make_unique<IoUringPipeServer>(socketPath);
+    }
+    LOG_TAGGED_INFO(Logger::LogTag::PIPE_SERVER, "io_uring is not available, using epoll");
+    return std::make_unique<UnixSocketPipeServer>(socketPath);
+}
+
+bool ioUringPipeServerSupported() {
+    return IoUringPipeServer::isSupported();
+}
+
+#else
+
+std::unique_ptr<PipeServerInterface> createIoUringPipeServer(const std::string& socketPath) {
+    LOG_TAGGED_INFO(Logger::LogTag::PIPE_SERVER, "Built without io_uring support, using epoll");
+    return std::make_unique<UnixSocketPipeServer>(socketPath);
+}
+
+bool ioUringPipeServerSupported() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef IO_URING_PIPE_SERVER_H
+#define IO_URING_PIPE_SERVER_H
+
+#include <memory>
+#include <string>
+
+#include "PipeServerInterface.h"
+
+// Unix domain socket transport driven by io_uring: one ring accepts clients with a
+// multishot accept, reads every connection with a multishot recv into a shared
+// group of provided buffers, and submits the responses queued since the last loop, one
+// sendmsg per client over its shared frame buffers, together with the re-armed
+// operations in a single io_uring_enter. Clients see exactly the same socket
+// protocol as UnixSocketPipeServer.
+//
+// The ring is driven through the system calls directly, so nothing beyond the
+// kernel headers is needed to build it. On kernels without multishot recv
+// (Linux 6.0), or where io_uring is disabled, this returns the epoll based
+// UnixSocketPipeServer instead.
+std::unique_ptr<PipeServerInterface> createIoUringPipeServer(const std::string& socketPath);
+
+// Whether createIoUringPipeServer() gets an io_uring transport on this system
+bool ioUringPipeServerSupported();
+
+#endif  // IO_URING_PIPE_SERVER_H
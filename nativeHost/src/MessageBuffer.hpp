@@ -0,0 +1,112 @@
+#ifndef MESSAGE_BUFFER_H
+#define MESSAGE_BUFFER_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Body of a single inbound frame.
+// Frames up to the in-memory limit live in an uninitialised heap block. Larger frames
+// are backed by an anonymous memfd (or an unlinked tmpfile when memfd is unavailable)
+// that is mapped for access: nothing is zero-filled up front, the pages can be
+// reclaimed by the kernel, and consumers can pass the descriptor on instead of
+// copying the bytes.
+class MessageBuffer {
+public:
+    static std::shared_ptr<MessageBuffer> create(size_t size, size_t inMemoryLimit) {
+        return std::shared_ptr<MessageBuffer>(new MessageBuffer(size, size > inMemoryLimit));
+    }
+
+    ~MessageBuffer() {
+        if (mapping_ != nullptr) {
+            munmap(mapping_, size_);
+        }
+        if (fd_ != -1) {
+            close(fd_);
+        }
+    }
+
+    char* data() { return mapping_ != nullptr ? mapping_ : heap_.get(); }
+    const char* data() const { return mapping_ != nullptr ? mapping_ : heap_.get(); }
+    size_t size() const { return size_; }
+
+    // Zero-copy view of the whole body
+    std::string_view view() const { return std::string_view(data(), size_); }
+
+    // Copy of the whole body, for consumers that need to own a string
+    std::string str() const { return std::string(data(), size_); }
+
+    // Descriptor backing a spilled buffer, or -1 for heap buffers. Owned by the buffer;
+    // dup() it to keep it beyond the buffer's lifetime.
+    int fd() const { return fd_; }
+
+    bool isSpilled() const { return fd_ != -1; }
+
+private:
+    MessageBuffer(size_t size, bool spill) : size_(size) {
+        if (!spill) {
+            heap_.reset(new char[size]);
+            return;
+        }
+
+        fd_ = memfd_create("native-messaging-frame", MFD_CLOEXEC);
+        if (fd_ == -1) {
+            fd_ = open("/tmp", O_TMPFILE | O_RDWR | O_EXCL | O_CLOEXEC, 0600);
+        }
+        if (fd_ == -1) {
+            throw std::runtime_error("Error creating spill file: " + std::string(strerror(errno)));
+        }
+
+        if (ftruncate(fd_, static_cast<off_t>(size)) == -1) {
+            int error = errno;
+            close(fd_);
+            throw std::runtime_error("Error sizing spill file: " + std::string(strerror(error)));
+        }
+
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (mapping == MAP_FAILED) {
+            int error = errno;
+            close(fd_);
+            throw std::runtime_error("Error mapping spill file: " + std::string(strerror(error)));
+        }
+        mapping_ = static_cast<char*>(mapping);
+    }
+
+    MessageBuffer(const MessageBuffer&) = delete;
+    MessageBuffer& operator=(const MessageBuffer&) = delete;
+
+    size_t size_;
+    std::unique_ptr<char[]> heap_;   // Body of an in-memory frame
+    int fd_{-1};                     // memfd/tmpfile of a spilled frame
+    char* mapping_{nullptr};         // Mapping of fd_
+};
+
+// Part of a frame's body, e.g. one entry of a batch, that keeps the whole frame
+// alive instead of copying the bytes out. Empty when default constructed.
+class MessageSlice {
+public:
+    MessageSlice() = default;
+
+    explicit MessageSlice(std::shared_ptr<const MessageBuffer> buffer)
+        : buffer_(std::move(buffer)), view_(buffer_ ? buffer_->view() : std::string_view()) {}
+
+    // view must lie within buffer
+    MessageSlice(std::shared_ptr<const MessageBuffer> buffer, std::string_view view)
+        : buffer_(std::move(buffer)), view_(view) {}
+
+    std::string_view view() const { return view_; }
+    bool empty() const { return view_.empty(); }
+
+private:
+    std::shared_ptr<const MessageBuffer> buffer_;
+    std::string_view view_;
+};
+
+#endif  // MESSAGE_BUFFER_H
@@ -5,8 +5,29 @@
 #include <optional>
 #include <thread>
 #include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
 
 #include "NativeMessagingHost.h"
+#include "ActionDispatcher.h"
+#include "ExtensionAnswer.hpp"
+#include "RequestContext.hpp"
+#include "SingleFlight.h"
+#include "ResponseCache.h"
+#include "TimerWheel.h"
+#include "WorkStealingPool.h"
 #include "PipeServer.h"
 #include "Logger.hpp"
 #include "json.hpp"
@@ -29,74 +50,518 @@ public:
         return instance;
     }
 
-    void run(std::string serverName) {
+    void run(std::string serverName, const PipeServerOptions& options = PipeServerOptions()) {
         
         logInfo( "NativeHostServer::run START");
 
-        server = std::make_unique<PipeServer>(serverName);
+        server = std::make_unique<PipeServer>(serverName, options);
+        // Nobody is left to answer: stop the work, which frees the client's slots
+        server->setDisconnectListener([this](PipeClientId clientId) { cancelClientRequests(clientId); });
         server->start();
         auto& nativeMessagingHost = NativeMessagingHost::getInstance();
+        // Tell pipe clients right away when Chrome goes away
+        nativeMessagingHost.setConnectionStateListener([this](NativeMessagingHost::ConnectionState state) {
+            if (state == NativeMessagingHost::ConnectionState::Disconnected) {
+                // Whatever comes back next may be a different browser session
+                cache.invalidateAll();
+                nlohmann::json event;
+                event["event"] = "chromeDisconnected";
+                server->sendEvent(event);
+            }
+        });
+        // The extension reports when the active tab changed: cached answers about it
+        // are stale, and subscribed pipe clients hear about it right away instead of
+        // polling, along with the new tab's metadata if anyone wants it
+        nativeMessagingHost.setEventListener([this](const std::string& event, std::string_view message) {
+            nlohmann::json pipeEvent = nlohmann::json::parse(message.begin(), message.end(), nullptr, false);
+            if (event == TAB_CHANGED_EVENT) {
+                cache.invalidateAll();
+                if (pipeEvent.is_object()) {
+                    server->publish(TAB_ACTIVE_TOPIC, pipeEvent);
+                }
+                if (server->hasSubscribers(TAB_META_TOPIC)) {
+                    publishTabMeta();
+                }
+            } else if (event == PLAYBACK_EVENT && pipeEvent.is_object()) {
+                server->publish(PLAYBACK_TOPIC, pipeEvent);
+                // Page metadata such as the YouTube timestamp moves with playback
+                cache.invalidateAll();
+                if (server->hasSubscribers(TAB_META_TOPIC)) {
+                    publishTabMeta();
+                }
+            }
+        });
         nativeMessagingHost.start();
+        try {
+            nativeMessagingHost.subscribe();
+        } catch (const ChromeDisconnectedError& ex) {
+            logError("cannot subscribe to tab changes: " + std::string(ex.what()));
+        }
+        pool = std::make_unique<WorkStealingPool>();
+        dispatcher.setExecutor([this](std::function<void()> task) { pool->submit(std::move(task)); });
+        registerActions();
 
         while(!stopRequested) {
-            auto jsonResult = server->readRequest();
+            // This loop drives the host's timers, e.g. the deadlines of coalesced requests
+            timers.advance();
+            auto wait = std::min(timers.nextExpiry().value_or(REQUEST_READ_TIMEOUT_MILLISECONDS),
+                                 REQUEST_READ_TIMEOUT_MILLISECONDS);
+            auto jsonResult = server->readRequest(wait);
             if (jsonResult.has_value()) {
-                auto obj = jsonResult.value();
-                std::string actionName = obj["action"];
-                
-                // handle only jsonObject with "action" field
-                if (!actionName.empty()) {
-                    nativeMessagingHost.sendRequest(actionName);
-                    auto data = nativeMessagingHost.readResponse();
-                    nlohmann::json jsonObject;
-                    jsonObject["action"] = actionName;
-                    if (data.has_value()) {
-                        jsonObject["data"] = data.value();
-                    } else {
-                        jsonObject["data"] = "";
-                    }
-                    server->sendResponse(jsonObject);
-                } else {
+                auto clientId = jsonResult.value().clientId;
+                auto requestId = jsonResult.value().requestId;
+                auto obj = jsonResult.value().body;
 
+                if (obj.is_array()) {
+                    dispatchBatch(clientId, requestId, obj);
+                } else if (obj.is_object() && obj.contains("cancel")) {
+                    // {"cancel": requestId} withdraws an earlier request of the same client
+                    cancelRequest(clientId, obj["cancel"]);
+                } else {
+                    // The dispatcher answers requests without a string "action" with an error
+                    dispatchRequest(clientId, requestId, obj);
                 }
 
-            } else {
+            } else if (wait == REQUEST_READ_TIMEOUT_MILLISECONDS) {
                 logInfo( "server->readRequest()  timeout");
                 // pipe server response timeout
             }
         }
     }
 
+    // How long a response of action may be answered from the cache (zero disables
+    // caching it); the extension's tabChanged events invalidate the cache earlier
+    void setCacheTtl(const std::string& action, std::chrono::milliseconds ttl) {
+        cache.setTtl(action, ttl);
+    }
+
     void stop() {
         stopRequested = true;
         server->stop();
         NativeMessagingHost::getInstance().stop();
+        if (pool) {
+            pool->stop();
+        }
     }
 
 private:
     NativeHostServer() {
+        cache.setTtl("tabInfo", DEFAULT_TAB_INFO_CACHE_TTL);
+    }
+
+    void registerActions() {
+        using HandlerKind = ActionDispatcher::HandlerKind;
+
+        using Context = std::shared_ptr<RequestContext>;
+
+        dispatcher.registerHandler("ping", HandlerKind::Local, [](const nlohmann::json&, const Context&, ActionDispatcher::Reply reply) {
+            nlohmann::json jsonObject;
+            jsonObject["action"] = "ping";
+            jsonObject["data"] = "pong";
+            reply(makeSharedMessage(std::move(jsonObject)));
+        });
+
+        dispatcher.registerHandler("stats", HandlerKind::Local, [this](const nlohmann::json&, const Context&, ActionDispatcher::Reply reply) {
+            reply(makeSharedMessage(statistics()));
+        });
+
+        // Requests the client marks {"idempotent":true} share a round trip with
+        // identical ones in flight
+        auto forward = [this](const nlohmann::json& request, const Context& context, ActionDispatcher::Reply reply) {
+            // The dispatcher only routes requests with a string action here
+            std::string actionName = ActionDispatcher::actionOf(request).value_or("");
+            if (!request.contains("idempotent") || request["idempotent"] != true) {
+                forwardToExtension(actionName, context, std::move(reply));
+                return;
+            }
+            singleFlight.run(actionName, context, std::move(reply),
+                             [this, actionName](const Context& flightContext, SingleFlight::Reply done) {
+                                 forwardToExtension(actionName, flightContext, std::move(done));
+                             });
+        };
+        // tabInfo describes the active tab: it is answered from the cache until the tab
+        // changes, and concurrent misses all get the answer of one round trip. The
+        // local file of a file:// tab is inspected on the pool, off the I/O threads,
+        // unless nobody waits for the answer any more.
+        dispatcher.registerHandler("tabInfo", HandlerKind::Remote, [this](const nlohmann::json&, const Context& context, ActionDispatcher::Reply reply) {
+            tabInfo(context, std::move(reply));
+        });
+        // Anything else is passed through to the extension, as before the registry
+        dispatcher.setFallbackHandler(HandlerKind::Remote, forward);
+    }
+
+    void tabInfo(const std::shared_ptr<RequestContext>& context, ActionDispatcher::Reply reply) {
+        if (auto cached = cache.get("tabInfo")) {
+            reply(std::move(cached));
+            return;
+        }
+        // A request after a tab change must not join a round trip started before it
+        auto generation = cache.generation();
+        std::string key = "tabInfo@" + std::to_string(generation);
+        singleFlight.run("tabInfo", key, context, std::move(reply), [this, generation](const std::shared_ptr<RequestContext>& flightContext, SingleFlight::Reply done) {
+            forwardToExtension("tabInfo", flightContext, [this, flightContext, generation, done](SharedMessagePtr response) {
+                pool->submit([this, response = std::move(response), flightContext, generation, done]() mutable {
+                    // Failures, including the extension's own such as no active tab,
+                    // are answered but never cached
+                    auto answer = extensionAnswer(response->value());
+                    if (answer.has_value()) {
+                        auto file = flightContext->abandoned() ? std::nullopt : inspectLocalFile(answer.value());
+                        if (file.has_value()) {
+                            nlohmann::json inspected = response->value();
+                            inspected["file"] = std::move(file.value());
+                            response = makeSharedMessage(std::move(inspected));
+                        }
+                        cache.put("tabInfo", response, generation);
+                    }
+                    done(std::move(response));
+                });
+            });
+        });
+    }
+
+    // Fetches tabInfo the way a client request would, so a client asking at the same
+    // time shares the round trip, and publishes the tab's state on TAB_META_TOPIC.
+    // That is the extension's data object itself rather than its answer as a string,
+    // so delta subscribers get patches of the fields that changed.
+    void publishTabMeta() {
+        auto generation = cache.generation();
+        tabInfo(std::make_shared<RequestContext>(), [this, generation](SharedMessagePtr message) {
+            const nlohmann::json& response = message->value();
+            // The tab changed again meanwhile: the refresh of that change publishes
+            if (cache.generation() != generation) {
+                return;
+            }
+            auto answer = extensionAnswer(response);
+            if (!answer.has_value()) {
+                return;
+            }
+            nlohmann::json meta = std::move(answer.value());
+            if (response.contains("file")) {
+                meta["file"] = response["file"];
+            }
+            server->publish(TAB_META_TOPIC, meta);
+        });
+    }
+
+    // Sends the action to the extension without waiting: reply runs from the
+    // completion callback on one of the native messaging threads. The client's
+    // deadline caps the wait, and cancelling the request withdraws it from the
+    // extension too.
+    void forwardToExtension(const std::string& actionName, const std::shared_ptr<RequestContext>& context,
+                            ActionDispatcher::Reply reply) {
+        auto& nativeMessagingHost = NativeMessagingHost::getInstance();
+        auto complete = [actionName, context, reply](NativeMessagingHost::ResponseStatus status,
+                                                     const MessageSlice& response) {
+            nlohmann::json jsonObject;
+            jsonObject["action"] = actionName;
+            // The pipe response carries the extension's answer as a JSON string, so
+            // this is where its bytes get copied out of the received frame
+            jsonObject["data"] = std::string(response.view());
+            if (status == NativeMessagingHost::ResponseStatus::Disconnected) {
+                jsonObject["error"] = "disconnected";
+            } else if (status == NativeMessagingHost::ResponseStatus::Cancelled) {
+                jsonObject["error"] = "cancelled";
+            } else if (status == NativeMessagingHost::ResponseStatus::Timeout) {
+                jsonObject["error"] = context->expired() ? "deadline exceeded" : "timeout";
+            }
+            reply(makeSharedMessage(std::move(jsonObject)));
+        };
+
+        try {
+            auto timeout = context->remaining(nativeMessagingHost.responseTimeout(actionName));
+            auto id = nativeMessagingHost.sendRequest(actionName, timeout, complete);
+            context->setCancelHook([id] { NativeMessagingHost::getInstance().cancelRequest(id); });
+        } catch (const ChromeDisconnectedError& ex) {
+            complete(NativeMessagingHost::ResponseStatus::Disconnected, MessageSlice());
+        }
+    }
+
+    // {"path","size","modified"} of the local file when the extension's answer
+    // reported a file:// tab, or {"path","error"} if the file cannot be read; the
+    // response carries it as "file"
+    static std::optional<nlohmann::json> inspectLocalFile(const nlohmann::json& data) {
+        if (!data.contains("file") || !data["file"].is_string()) {
+            return std::nullopt;
+        }
+
+        nlohmann::json file;
+        file["path"] = decodeFileUrlPath(data["file"].get<std::string>());
+        struct stat status{};
+        if (stat(file["path"].get<std::string>().c_str(), &status) == -1) {
+            file["error"] = std::string(strerror(errno));
+        } else {
+            file["size"] = static_cast<uint64_t>(status.st_size);
+            file["modified"] = static_cast<int64_t>(status.st_mtime);
+        }
+        return file;
+    }
+
+    // file:// URLs percent-encode anything outside the URL character set
+    static std::string decodeFileUrlPath(const std::string& encoded) {
+        std::string path;
+        path.reserve(encoded.size());
+        for (size_t i = 0; i < encoded.size(); ++i) {
+            if (encoded[i] == '%' && i + 2 < encoded.size() && std::isxdigit(static_cast<unsigned char>(encoded[i + 1]))
+                && std::isxdigit(static_cast<unsigned char>(encoded[i + 2]))) {
+                path += static_cast<char>(std::stoi(encoded.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            } else {
+                path += encoded[i];
+            }
+        }
+        return path;
+    }
+
+    nlohmann::json statistics() {
+        auto& nativeMessagingHost = NativeMessagingHost::getInstance();
+        nlohmann::json data;
+        data["actions"] = dispatcher.statistics();
+        data["connected"] = nativeMessagingHost.connectionState() == NativeMessagingHost::ConnectionState::Connected;
+        data["rtt"] = nlohmann::json::object();
+        for (const auto& [request, estimate] : nativeMessagingHost.rttEstimates()) {
+            nlohmann::json rtt;
+            rtt["samples"] = estimate.samples;
+            rtt["p50Microseconds"] = estimate.p50.count();
+            rtt["p99Microseconds"] = estimate.p99.count();
+            rtt["timeoutMilliseconds"] = estimate.timeout.count();
+            data["rtt"][request] = rtt;
+        }
+
+        auto cacheStatistics = cache.statistics();
+        data["cache"]["hits"] = cacheStatistics.hits;
+        data["cache"]["misses"] = cacheStatistics.misses;
+        data["cache"]["invalidations"] = cacheStatistics.invalidations;
+        data["cache"]["entries"] = cacheStatistics.entries;
+
+        auto coalescing = singleFlight.statistics();
+        data["coalescing"]["executions"] = coalescing.executions;
+        data["coalescing"]["joined"] = coalescing.joined;
+        data["coalescing"]["inFlight"] = coalescing.inFlight;
+
+        data["topics"] = server->topicStatistics();
+
+        auto poolMetrics = pool->metrics();
+        data["pool"]["workers"] = pool->workerCount();
+        data["pool"]["executed"] = poolMetrics.executed;
+        data["pool"]["steals"] = poolMetrics.steals;
+        data["pool"]["queueLengths"] = poolMetrics.queueLengths;
+
+        nlohmann::json jsonObject;
+        jsonObject["action"] = "stats";
+        jsonObject["data"] = data;
+        return jsonObject;
+    }
+
+    // Replies are tagged with the client's request id, so a client can keep many
+    // requests in flight and match replies that arrive out of order. An optional
+    // "timeoutMs" is the client's deadline, counted from when the request is read.
+    void dispatchRequest(PipeClientId clientId, uint32_t requestId, const nlohmann::json& request) {
+        auto context = makeRequestContext(request);
+        if (!context) {
+            nlohmann::json jsonObject;
+            jsonObject["action"] = ActionDispatcher::actionOf(request).value_or("");
+            jsonObject["data"] = "";
+            jsonObject["error"] = "invalid timeoutMs";
+            server->sendResponse(clientId, requestId, jsonObject);
+            return;
+        }
+        if (!acquireInFlightSlots(clientId, requestId, context, 1)) {
+            nlohmann::json jsonObject;
+            jsonObject["action"] = ActionDispatcher::actionOf(request).value_or("");
+            jsonObject["data"] = "";
+            jsonObject["error"] = "too many requests in flight";
+            server->sendResponse(clientId, requestId, jsonObject);
+            return;
+        }
+
+        dispatcher.dispatch(request, context, [this, clientId, requestId](SharedMessagePtr response) {
+            releaseInFlightSlots(clientId, requestId, 1);
+            server->sendResponse(clientId, requestId, std::move(response));
+        });
+    }
+
+    // A batch is an array of action objects answered by one array of results in the
+    // same order (ActionDispatcher::dispatchBatch). The items are dispatched together,
+    // so the ones forwarded to the extension are in flight at the same time and leave
+    // in one write. Each item is one of the client's in-flight requests, and
+    // cancelling the batch cancels all of them.
+    void dispatchBatch(PipeClientId clientId, uint32_t requestId, const nlohmann::json& items) {
+        if (items.empty() || items.size() > MAX_BATCH_ITEMS) {
+            nlohmann::json jsonObject;
+            jsonObject["data"] = "";
+            jsonObject["error"] = "a batch holds 1 to " + std::to_string(MAX_BATCH_ITEMS) + " actions";
+            server->sendResponse(clientId, requestId, jsonObject);
+            return;
+        }
+
+        std::vector<std::shared_ptr<RequestContext>> contexts;
+        contexts.reserve(items.size());
+        for (const auto& item : items) {
+            contexts.push_back(makeRequestContext(item));
+            if (!contexts.back()) {
+                nlohmann::json jsonObject;
+                jsonObject["data"] = "";
+                jsonObject["error"] = "invalid timeoutMs";
+                server->sendResponse(clientId, requestId, jsonObject);
+                return;
+            }
+        }
+        auto batchContext = std::make_shared<RequestContext>();
+        batchContext->setCancelHook([contexts] {
+            for (const auto& context : contexts) {
+                context->cancel();
+            }
+        });
+
+        if (!acquireInFlightSlots(clientId, requestId, batchContext, items.size())) {
+            nlohmann::json jsonObject;
+            jsonObject["data"] = "";
+            jsonObject["error"] = "too many requests in flight";
+            server->sendResponse(clientId, requestId, jsonObject);
+            return;
+        }
+
+        size_t slots = items.size();
+        dispatcher.dispatchBatch(items, contexts, [this, clientId, requestId, slots](SharedMessagePtr results) {
+            releaseInFlightSlots(clientId, requestId, slots);
+            server->sendResponse(clientId, requestId, std::move(results));
+        });
+    }
+
+    // An optional "timeoutMs" is the client's deadline, counted from now and capped at
+    // MAX_CLIENT_TIMEOUT_MILLISECONDS. nullptr if it is not a non-negative integer.
+    static std::shared_ptr<RequestContext> makeRequestContext(const nlohmann::json& request) {
+        std::optional<RequestContext::Clock::time_point> deadline;
+        if (request.is_object()) {
+            auto timeout = request.find("timeoutMs");
+            if (timeout != request.end()) {
+                if (!timeout->is_number_integer() || (!timeout->is_number_unsigned() && timeout->get<int64_t>() < 0)) {
+                    return nullptr;
+                }
+                auto milliseconds = std::min<uint64_t>(timeout->get<uint64_t>(), MAX_CLIENT_TIMEOUT_MILLISECONDS.count());
+                deadline = RequestContext::Clock::now() + std::chrono::milliseconds(milliseconds);
+            }
+        }
+        return std::make_shared<RequestContext>(deadline);
+    }
 
+    // The request is still answered, with an error "cancelled" unless its reply was
+    // already on the way
+    void cancelRequest(PipeClientId clientId, const nlohmann::json& requestId) {
+        // Pipe request ids are 32 bits: anything else names no request
+        if (!requestId.is_number_unsigned() || requestId.get<uint64_t>() > UINT32_MAX) {
+            return;
+        }
+        std::shared_ptr<RequestContext> context;
+        {
+            std::lock_guard<std::mutex> lock(inFlightMutex);
+            auto call = inFlightCalls.find({clientId, static_cast<uint32_t>(requestId.get<uint64_t>())});
+            if (call == inFlightCalls.end()) {
+                return;
+            }
+            context = call->second;
+        }
+        context->cancel();
     }
+
+    void cancelClientRequests(PipeClientId clientId) {
+        std::vector<std::shared_ptr<RequestContext>> contexts;
+        {
+            std::lock_guard<std::mutex> lock(inFlightMutex);
+            auto call = inFlightCalls.lower_bound({clientId, 0});
+            for (; call != inFlightCalls.end() && call->first.first == clientId; ++call) {
+                contexts.push_back(call->second);
+            }
+        }
+        for (const auto& context : contexts) {
+            context->cancel();
+        }
+    }
+
+    bool acquireInFlightSlots(PipeClientId clientId, uint32_t requestId, const std::shared_ptr<RequestContext>& context,
+                              size_t slots) {
+        std::lock_guard<std::mutex> lock(inFlightMutex);
+        auto& count = inFlight[clientId];
+        if (count + slots > MAX_IN_FLIGHT_PER_CLIENT) {
+            if (count == 0) {
+                inFlight.erase(clientId);
+            }
+            return false;
+        }
+        count += slots;
+        inFlightCalls[{clientId, requestId}] = context;
+        return true;
+    }
+
+    void releaseInFlightSlots(PipeClientId clientId, uint32_t requestId, size_t slots) {
+        std::lock_guard<std::mutex> lock(inFlightMutex);
+        inFlightCalls.erase({clientId, requestId});
+        auto count = inFlight.find(clientId);
+        if (count != inFlight.end() && (count->second -= slots) == 0) {
+            inFlight.erase(count);
+        }
+    }
+
 private:
+    // Requests one pipe client may have waiting on the extension at the same time
+    static constexpr size_t MAX_IN_FLIGHT_PER_CLIENT = 64;
+    static constexpr size_t MAX_BATCH_ITEMS = MAX_IN_FLIGHT_PER_CLIENT;
+    // Longest deadline a client may ask for; longer ones are capped to it
+    static constexpr std::chrono::milliseconds MAX_CLIENT_TIMEOUT_MILLISECONDS = std::chrono::minutes(10);
+    static constexpr std::chrono::milliseconds REQUEST_READ_TIMEOUT_MILLISECONDS = std::chrono::milliseconds(2000);
+    // A safety net: tab changes invalidate the cache as they happen
+    static constexpr std::chrono::milliseconds DEFAULT_TAB_INFO_CACHE_TTL = std::chrono::milliseconds(2000);
+    static constexpr const char* TAB_CHANGED_EVENT = "tabChanged";
+    static constexpr const char* PLAYBACK_EVENT = "playback";
+    // Topics pipe clients can subscribe to
+    static constexpr const char* TAB_ACTIVE_TOPIC = "tab.active";   // Every tabChanged event
+    static constexpr const char* TAB_META_TOPIC = "tab.meta";       // State of the active tab after each change
+    static constexpr const char* PLAYBACK_TOPIC = "playback";       // Media elements starting, pausing or ending
 
     std::atomic_bool            stopRequested;
     std::string                 pipeServerName;
     std::unique_ptr<PipeServer> server;
+    std::mutex                  inFlightMutex;
+    std::map<PipeClientId, size_t> inFlight;
+    std::map<std::pair<PipeClientId, uint32_t>, std::shared_ptr<RequestContext>> inFlightCalls;   // For cancel
+    ActionDispatcher            dispatcher;
+    TimerWheel                  timers;
+    SingleFlight                singleFlight{timers};
+    ResponseCache               cache{timers};
+    std::unique_ptr<WorkStealingPool> pool;
 };
 
 void testNativeMessaging() {
         auto& nativeMessagingHost = NativeMessagingHost::getInstance();
         nativeMessagingHost.start();
+        try {
+            nativeMessagingHost.subscribe();
+        } catch (const ChromeDisconnectedError& ex) {
+            logError("subscribe : " + std::string(ex.what()));
+            return;
+        }
+        // Ask once, then again only when the extension reports that the tab changed
+        bool tabChanged = true;
         while(true) {
-            nativeMessagingHost.sendRequest("tabInfo");
-            auto response = nativeMessagingHost.readResponse();
-            if (response.has_value()) {
-                 logInfo("response: " + response.value());
-            } else {
-                logError("response : no response from extension ");
+            try {
+                if (tabChanged) {
+                    nativeMessagingHost.sendRequest("tabInfo");
+                    auto response = nativeMessagingHost.readResponse(nativeMessagingHost.responseTimeout("tabInfo"));
+                    if (response.has_value()) {
+                         logInfo("response: " + response.value());
+                    } else {
+                        logError("response : no response from extension ");
+                    }
+                }
+                auto event = nativeMessagingHost.readEvent(std::chrono::seconds(60));
+                tabChanged = event.has_value();
+                if (tabChanged) {
+                    logInfo("event: " + event.value());
+                }
+            } catch (const ChromeDisconnectedError& ex) {
+                logError("response : " + std::string(ex.what()));
+                break;
             }
-            // Sleep for 3 seconds
-            std::this_thread::sleep_for(std::chrono::seconds(3));
         } 
 }
 
@@ -112,6 +577,9 @@ void signalHandler(int signal) {
 
 
 int main() {
+    // A closed Chrome port must surface as EPIPE, not kill the process
+    std::signal(SIGPIPE, SIG_IGN);
+
     testNativeMessaging();
     // // Set up signal handler for Ctrl+C
     // std::signal(SIGINT, signalHandler);
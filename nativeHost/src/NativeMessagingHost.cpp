@@ -8,12 +8,26 @@
 #include <stdexcept>
 #include <csignal>
 #include <queue>
+#include <deque>
+#include <map>
+#include <functional>
+#include <vector>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cctype>
+#include <string_view>
+
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "Logger.hpp"
 #include "ConcurrentQueue.hpp"
+#include "RttEstimator.hpp"
+#include "TimerWheel.h"
 #include "NativeMessagingHost.h"
-
-#define JSON_NO_IO
 #include "json.hpp"
 
 using json = nlohmann::json;
@@ -26,6 +40,378 @@ namespace {
     inline void logInfo(const std::string& infoMessage) {
         LOG_TAGGED_INFO(Logger::LogTag::NETIVE_MESSAGING, infoMessage);
     }
+
+    // Read exactly size bytes, retrying on EINTR. Returns false on EOF or error.
+    bool readExact(int fd, char* buffer, size_t size) {
+        size_t filled = 0;
+        while (filled < size) {
+            ssize_t bytesRead = ::read(fd, buffer + filled, size - filled);
+            if (bytesRead == -1 && errno == EINTR) {
+                continue;
+            }
+            if (bytesRead <= 0) {
+                return false;
+            }
+            filled += static_cast<size_t>(bytesRead);
+        }
+        return true;
+    }
+
+    // Top-level fields of an inbound frame, picked out while the frame is still
+    // being read so consumers can route it without parsing the body again
+    struct FrameEnvelope {
+        std::string response;
+        std::string event;            // Set on frames the extension pushes on its own
+        std::optional<uint64_t> id;   // Echoed id of a pipelined request
+        bool unwanted{false};         // Its request already completed, parsing stopped early
+    };
+
+    // Streams a frame body from a descriptor into its MessageBuffer. The iterators
+    // pull more bytes only when the parser reaches the end of what has arrived, so
+    // the parser works on the first bytes before the last ones are read.
+    class StreamingFrameSource {
+    public:
+        StreamingFrameSource(int fd, MessageBuffer& buffer) : fd(fd), buffer(buffer) {}
+
+        class iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = char;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const char*;
+            using reference = const char&;
+
+            iterator(StreamingFrameSource* source, size_t position) : source(source), position(position) {}
+
+            char operator*() const {
+                if (position == source->received && !source->fill()) {
+                    return '\0'; // turns into a parse error, source->failed is set
+                }
+                return source->buffer.data()[position];
+            }
+            iterator& operator++() { ++position; return *this; }
+            bool operator==(const iterator& other) const { return position == other.position; }
+            bool operator!=(const iterator& other) const { return position != other.position; }
+
+        private:
+            StreamingFrameSource* source;
+            size_t position;
+        };
+
+        iterator begin() { return iterator(this, 0); }
+        iterator end() { return iterator(this, buffer.size()); }
+
+        // Read whatever part of the frame the parser did not consume
+        bool drain() {
+            while (received < buffer.size()) {
+                if (!fill()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool hasFailed() const { return failed; }
+
+    private:
+        bool fill() {
+            if (failed) {
+                return false;
+            }
+            ssize_t bytesRead = ::read(fd, buffer.data() + received, buffer.size() - received);
+            while (bytesRead == -1 && errno == EINTR) {
+                bytesRead = ::read(fd, buffer.data() + received, buffer.size() - received);
+            }
+            if (bytesRead <= 0) {
+                failed = true;
+                return false;
+            }
+            received += static_cast<size_t>(bytesRead);
+            return true;
+        }
+
+        int fd;
+        MessageBuffer& buffer;
+        size_t received{0};
+        bool failed{false};
+    };
+
+    // SAX handler validating a frame and collecting its FrameEnvelope. Once the id
+    // shows the frame answers a request nobody waits for any more, parsing stops so
+    // the rest of the body is skipped unread by the parser.
+    class EnvelopeSaxHandler : public nlohmann::json_sax<json> {
+    public:
+        using IdFilter = std::function<bool(uint64_t id)>;
+
+        EnvelopeSaxHandler(FrameEnvelope& envelope, IdFilter wanted) : envelope(envelope), wanted(std::move(wanted)) {}
+
+        bool null() override { return true; }
+        bool boolean(bool) override { return true; }
+        bool number_integer(number_integer_t value) override {
+            if (depth == 1 && currentKey == "id" && value >= 0) {
+                return acceptId(static_cast<uint64_t>(value));
+            }
+            return true;
+        }
+
+        bool number_unsigned(number_unsigned_t value) override {
+            if (depth == 1 && currentKey == "id") {
+                return acceptId(value);
+            }
+            return true;
+        }
+
+        bool number_float(number_float_t, const string_t&) override { return true; }
+        bool binary(binary_t&) override { return true; }
+
+        bool string(string_t& value) override {
+            if (depth == 1 && currentKey == "response") {
+                envelope.response = std::move(value);
+            } else if (depth == 1 && currentKey == "event") {
+                envelope.event = std::move(value);
+            }
+            return true;
+        }
+
+        bool start_object(std::size_t) override { ++depth; return true; }
+        bool end_object() override { --depth; return true; }
+        bool start_array(std::size_t) override { ++depth; return true; }
+        bool end_array() override { --depth; return true; }
+
+        bool key(string_t& value) override {
+            if (depth == 1) {
+                currentKey = std::move(value);
+            }
+            return true;
+        }
+
+        bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+            error = ex.what();
+            return false;
+        }
+
+        const std::string& errorMessage() const { return error; }
+
+    private:
+        bool acceptId(uint64_t id) {
+            envelope.id = id;
+            envelope.unwanted = !wanted(id);
+            return !envelope.unwanted;
+        }
+
+        FrameEnvelope& envelope;
+        IdFilter wanted;
+        int depth{0};
+        std::string currentKey;
+        std::string error;
+    };
+
+    // Byte ranges of the entries of the top-level "batch" array of a frame the
+    // reader already validated, found by tracking nesting and strings only, so the
+    // entries are neither parsed into a DOM nor copied. nullopt without such array.
+    std::optional<std::vector<std::string_view>> batchEntries(std::string_view frame) {
+        std::vector<std::string_view> entries;
+        bool inBatch = false;
+        bool foundBatch = false;
+        bool expectKey = false;
+        std::string_view lastKey;
+        size_t entryStart = std::string_view::npos;
+        int depth = 0;
+
+        auto closeEntry = [&](size_t end) {
+            if (entryStart == std::string_view::npos) {
+                return;
+            }
+            while (end > entryStart && std::isspace(static_cast<unsigned char>(frame[end - 1]))) {
+                --end;
+            }
+            entries.push_back(frame.substr(entryStart, end - entryStart));
+            entryStart = std::string_view::npos;
+        };
+
+        for (size_t i = 0; i < frame.size(); ++i) {
+            char c = frame[i];
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                continue;
+            }
+            if (inBatch && depth == 2 && entryStart == std::string_view::npos && c != ']') {
+                entryStart = i;
+            }
+            switch (c) {
+            case '"': {
+                size_t begin = i + 1;
+                for (++i; i < frame.size() && frame[i] != '"'; ++i) {
+                    if (frame[i] == '\\') {
+                        ++i;
+                    }
+                }
+                if (i >= frame.size()) {
+                    return std::nullopt;
+                }
+                if (depth == 1 && expectKey) {
+                    lastKey = frame.substr(begin, i - begin);
+                    expectKey = false;
+                }
+                break;
+            }
+            case '{':
+                ++depth;
+                expectKey = depth == 1;
+                break;
+            case '[':
+                ++depth;
+                if (depth == 2 && lastKey == "batch") {
+                    inBatch = foundBatch = true;
+                }
+                break;
+            case '}':
+            case ']':
+                if (inBatch && depth == 2) {
+                    closeEntry(i);
+                    inBatch = false;
+                }
+                --depth;
+                break;
+            case ',':
+                if (inBatch && depth == 2) {
+                    closeEntry(i);
+                }
+                expectKey = depth == 1;
+                break;
+            default:
+                break;
+            }
+        }
+        if (!foundBatch || depth != 0) {
+            return std::nullopt;
+        }
+        return entries;
+    }
+}
+
+namespace {
+    // Collects outgoing frames and hands them to the sink in batches, bounded by
+    // frame count and bytes, so one writev covers as many frames as possible while
+    // memory stays bounded even for very large chunked messages
+    class OutboundFrameBatch {
+    public:
+        using Sink = std::function<bool(const std::vector<std::string>&)>;
+
+        OutboundFrameBatch(Sink sink, size_t maxFrames, size_t byteBudget)
+            : sink(std::move(sink)), maxFrames(maxFrames), byteBudget(byteBudget) {}
+
+        void add(std::string frame) {
+            bytes += frame.size();
+            frames.push_back(std::move(frame));
+            if (frames.size() >= maxFrames || bytes >= byteBudget) {
+                flush();
+            }
+        }
+
+        void flush() {
+            if (!frames.empty() && !failed) {
+                failed = !sink(frames);
+            }
+            frames.clear();
+            bytes = 0;
+        }
+
+        bool hasFailed() const { return failed; }
+
+    private:
+        Sink sink;
+        size_t maxFrames;
+        size_t byteBudget;
+        std::vector<std::string> frames;
+        size_t bytes{0};
+        bool failed{false};
+    };
+
+    // Output adapter for the json serializer that never holds more than one frame of
+    // the message. Output up to maxFrameBytes becomes a plain frame. Past that, the
+    // text is escaped into the "data" string of sequenced chunk frames
+    //   {"chunk":{"id":7,"seq":0,"last":false},"data":"..."}
+    // which are emitted while serialization is still running.
+    class ChunkingOutputAdapter : public nlohmann::detail::output_adapter_protocol<char> {
+    public:
+        ChunkingOutputAdapter(OutboundFrameBatch& batch, uint64_t chunkId, size_t maxFrameBytes)
+            : batch(batch), chunkId(chunkId), maxFrameBytes(maxFrameBytes) {}
+
+        void write_character(char c) override {
+            write_characters(&c, 1);
+        }
+
+        void write_characters(const char* s, std::size_t length) override {
+            if (!chunked) {
+                if (text.size() + length <= maxFrameBytes) {
+                    text.append(s, length);
+                    return;
+                }
+                // Too large for one frame: replay what we have into chunks
+                chunked = true;
+                std::string pending;
+                pending.swap(text);
+                appendEscaped(pending.data(), pending.size());
+            }
+            appendEscaped(s, length);
+        }
+
+        // Emit the plain frame or the final chunk
+        void finish() {
+            if (!chunked) {
+                batch.add(std::move(text));
+            } else {
+                emitChunk("\"last\":true");
+            }
+        }
+
+        // Tell the extension to discard a chunk stream that could not be completed
+        void abort() {
+            if (chunked) {
+                chunkData.clear();
+                emitChunk("\"abort\":true");
+            }
+        }
+
+    private:
+        // Room kept in each chunk frame for the envelope around "data"
+        static constexpr size_t CHUNK_ENVELOPE_BYTES = 128;
+
+        void appendEscaped(const char* s, std::size_t length) {
+            size_t dataBudget = maxFrameBytes - CHUNK_ENVELOPE_BYTES;
+            for (size_t i = 0; i < length; ++i) {
+                char c = s[i];
+                // Only split before an ASCII or UTF-8 lead byte, never inside a sequence
+                bool continuation = (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+                if (!continuation && chunkData.size() + 2 > dataBudget) {
+                    emitChunk("\"last\":false");
+                }
+                if (c == '"' || c == '\\') {
+                    chunkData.push_back('\\');
+                }
+                chunkData.push_back(c);
+            }
+        }
+
+        void emitChunk(const std::string& state) {
+            std::string frame;
+            frame.reserve(chunkData.size() + CHUNK_ENVELOPE_BYTES);
+            frame += "{\"chunk\":{\"id\":" + std::to_string(chunkId) + ",\"seq\":" + std::to_string(sequence++)
+                   + "," + state + "},\"data\":\"";
+            frame += chunkData;
+            frame += "\"}";
+            chunkData.clear();
+            batch.add(std::move(frame));
+        }
+
+        OutboundFrameBatch& batch;
+        uint64_t chunkId;
+        size_t maxFrameBytes;
+        bool chunked{false};
+        std::string text;        // Unescaped output while it still fits a plain frame
+        std::string chunkData;   // Escaped output of the chunk being filled
+        uint64_t sequence{0};
+    };
 }
 
 class NativeMessagingHost::NativeMessagingHostImpl {
@@ -39,6 +425,8 @@ public:
     }
 
     void start() {
+        setConnectionState(ConnectionState::Connected);
+        scheduleHeartbeat();
         try {
             readThread = std::thread(&NativeMessagingHostImpl::readHandler, this);
             writeThread = std::thread(&NativeMessagingHostImpl::writeHandler, this);
@@ -48,6 +436,9 @@ public:
     }
 
     void stop() {
+        if (connectionState == ConnectionState::Connected) {
+            setConnectionState(ConnectionState::Draining);
+        }
         stopRequested = true;
         logInfo("STOP start");
         requestQueue.notifyAll();
@@ -60,7 +451,8 @@ public:
         if (writeThread.joinable()) {
             writeThread.join();
         }
-        
+
+        setConnectionState(ConnectionState::Disconnected);
         logInfo("STOP end");
 
     }
@@ -69,65 +461,702 @@ public:
         return stopRequested;
     }
 
-    void sendRequest(const std::string& request) {
+    ConnectionState getConnectionState() {
+        return connectionState;
+    }
+
+    void setConnectionStateListener(std::function<void(ConnectionState)> listener) {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        connectionStateListener = std::move(listener);
+    }
+
+    void setEventListener(EventListener listener) {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        eventListener = std::move(listener);
+    }
+
+    void subscribe() {
+        throwUnlessConnected();
+        subscribed = true;
+        json request;
+        request["request"] = SUBSCRIBE_REQUEST;
+        // Not a round trip: no response is recorded or expected
         requestQueue.push(request);
     }
 
+    std::optional<std::string> readEvent(std::chrono::milliseconds timeout) {
+        if (connectionState == ConnectionState::Disconnected) {
+            throwUnlessConnected();
+        }
+
+        auto event = eventQueue.pop(timeout);
+        if (!event.has_value() && connectionState == ConnectionState::Disconnected) {
+            throwUnlessConnected();
+        }
+        if (event.has_value()) {
+            --queuedEvents;
+        }
+        return event;
+    }
+
+    void sendRequest(const std::string& request) {
+        json requestJson;
+        requestJson["request"] = request;
+        sendMessage(requestJson);
+    }
+
+    uint64_t sendRequest(const std::string& request, std::chrono::milliseconds timeout, ResponseCallback callback) {
+        throwUnlessConnected();
+
+        auto now = std::chrono::steady_clock::now();
+        json requestJson;
+        requestJson["request"] = request;
+        requestJson["timeoutMs"] = timeout.count();
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            id = nextRequestId++;
+            requestJson["id"] = id;
+            auto& pending = pendingRequests.emplace(id, PendingRequest{request, std::move(callback), now, 0, false}).first->second;
+            // Fires on the write thread, which waits on pendingMutex until this is set
+            pending.timer = timers.schedule(now + timeout, [this, id] { expirePendingRequest(id); });
+        }
+
+        // Lost the race with a disconnect that already failed everything pending
+        if (connectionState == ConnectionState::Disconnected && takePendingRequest(id).has_value()) {
+            throwUnlessConnected();
+        }
+        {
+            std::lock_guard<std::mutex> lock(rttMutex);
+            lastRequestSent = now;
+        }
+        requestQueue.push(requestJson);
+        return id;
+    }
+
+    bool cancelRequest(uint64_t id) {
+        auto pending = takePendingRequest(id);
+        if (!pending.has_value()) {
+            return false;
+        }
+        if (pending->written && connectionState == ConnectionState::Connected) {
+            json cancel;
+            cancel["cancel"] = id;
+            requestQueue.push(cancel);
+        }
+        pending->callback(ResponseStatus::Cancelled, MessageSlice());
+        return true;
+    }
+
+    void sendMessage(const json& message) {
+        throwUnlessConnected();
+        auto request = message.find("request");
+        if (request != message.end() && request->is_string()) {
+            recordRequestSent(request->get<std::string>());
+        }
+        requestQueue.push(message);
+    }
+
+    std::chrono::milliseconds responseTimeout(const std::string& request) {
+        std::lock_guard<std::mutex> lock(rttMutex);
+        return responseTimeoutLocked(request);
+    }
+
+    std::map<std::string, RttEstimate> rttEstimates() {
+        std::lock_guard<std::mutex> lock(rttMutex);
+        std::map<std::string, RttEstimate> estimates;
+        for (const auto& [request, estimator] : rttByRequest) {
+            auto estimate = estimator.estimate();
+            estimates[request] = RttEstimate{estimate.samples, estimate.p50, estimate.p99, responseTimeoutLocked(request)};
+        }
+        return estimates;
+    }
+
     std::optional<std::string> readResponse(std::chrono::milliseconds timeout) {
-        return messageQueue.pop(timeout);
+        auto message = popResponse(timeout);
+        if (!message.has_value()) {
+            return std::nullopt;
+        }
+        return message.value().buffer->str();
+    }
+
+    std::shared_ptr<const MessageBuffer> readResponseBuffer(std::chrono::milliseconds timeout) {
+        auto message = popResponse(timeout);
+        if (!message.has_value()) {
+            return nullptr;
+        }
+        return message.value().buffer;
+    }
+
+    void setInMemoryFrameLimit(size_t bytes) {
+        inMemoryFrameLimit = bytes;
+    }
+
+    void setBatchWindow(std::chrono::microseconds window) {
+        batchWindow = window;
     }
 
 private:
     static constexpr std::chrono::milliseconds REQUEST_QUEUE_READ_TIMEOUT_MILLISECONDS = std::chrono::milliseconds(1000);
+    // Adaptive response timeouts: p99 x factor, clamped, once enough samples exist
+    static constexpr std::chrono::milliseconds RESPONSE_TIMEOUT_FLOOR_MILLISECONDS = std::chrono::milliseconds(100);
+    static constexpr std::chrono::milliseconds RESPONSE_TIMEOUT_CEILING_MILLISECONDS = std::chrono::milliseconds(10000);
+    // Send times kept per request type; beyond this the oldest is forgotten
+    static constexpr size_t MAX_OUTSTANDING_PER_REQUEST = 256;
+    static constexpr int RESPONSE_TIMEOUT_P99_FACTOR = 3;
+    static constexpr size_t RESPONSE_TIMEOUT_MIN_SAMPLES = 8;
+    // A ping is sent after this long without traffic to keep the estimates current
+    static constexpr std::chrono::milliseconds IDLE_PING_INTERVAL_MILLISECONDS = std::chrono::milliseconds(5000);
+    static constexpr const char* PING_REQUEST = "ping";
+    static constexpr const char* SUBSCRIBE_REQUEST = "subscribe";
+    // Pushed events kept for readEvent; older ones are dropped first
+    static constexpr size_t MAX_QUEUED_EVENTS = 256;
+    // Upper bounds for a single coalesced writev: IOV_MAX allows 1024 buffers and each
+    // frame needs two (length header + payload)
+    static constexpr size_t WRITE_BATCH_MAX_FRAMES = 512;
+    static constexpr size_t WRITE_BATCH_BYTE_BUDGET = 256 * 1024;
+    // Pipelined requests combined into one batch frame at most
+    static constexpr size_t REQUEST_BATCH_MAX_REQUESTS = 64;
+    static constexpr std::chrono::microseconds DEFAULT_BATCH_WINDOW = std::chrono::microseconds(2000);
+    static constexpr const char* BATCH_RESPONSE = "batch";
+    // Chrome drops the port on host-to-extension messages above 1 MB
+    static constexpr size_t MAX_OUTBOUND_FRAME_BYTES = 1024 * 1024;
     std::thread readThread;
     std::thread writeThread;
     std::atomic_bool stopRequested;
+    std::atomic<ConnectionState> connectionState{ConnectionState::Disconnected};
+    std::mutex listenerMutex;
+    std::function<void(ConnectionState)> connectionStateListener;
+    EventListener eventListener;
+    // Chrome refuses to send messages above 64 MiB, anything larger is a corrupt length
+    static constexpr uint32_t MAX_INBOUND_FRAME_BYTES = 64 * 1024 * 1024;
+    static constexpr size_t DEFAULT_IN_MEMORY_FRAME_LIMIT = 1024 * 1024;
+
+    struct InboundMessage {
+        std::shared_ptr<MessageBuffer> buffer;
+        FrameEnvelope envelope;
+    };
+
+    struct PendingRequest {
+        std::string request;
+        ResponseCallback callback;
+        std::chrono::steady_clock::time_point sentAt;
+        TimerWheel::TimerId timer;   // Deadline
+        bool written;                // Handed to the extension, which may be working on it
+    };
+
     std::ofstream logFile;
     std::string logFileName;
     std::mutex logFileMutex;
-    ConcurrentQueue<std::string> requestQueue;
-    ConcurrentQueue<std::string> messageQueue;
+    std::atomic<size_t> inMemoryFrameLimit{DEFAULT_IN_MEMORY_FRAME_LIMIT};
+    std::atomic<std::chrono::microseconds> batchWindow{DEFAULT_BATCH_WINDOW};
+    uint64_t nextChunkId{0};
+    std::mutex rttMutex;
+    std::map<std::string, RttEstimator> rttByRequest;
+    // Send times of requests still waiting for a response, per request type. Never
+    // empty; pruned on every send, and at most MAX_OUTSTANDING_PER_REQUEST each.
+    std::map<std::string, std::deque<std::chrono::steady_clock::time_point>> outstandingRequests;
+    std::chrono::steady_clock::time_point lastRequestSent;
+    ConcurrentQueue<json> requestQueue;
+    ConcurrentQueue<InboundMessage> messageQueue;
+    ConcurrentQueue<std::string> eventQueue;
+    std::atomic<size_t> queuedEvents{0};
+    std::atomic_bool subscribed{false};
+    // Request deadlines and the heartbeat; advanced by the write thread
+    TimerWheel timers;
+    // Pipelined requests by id
+    std::mutex pendingMutex;
+    uint64_t nextRequestId{1};
+    std::map<uint64_t, PendingRequest> pendingRequests;
+    std::atomic<size_t> writtenRequests{0};   // Pending requests the extension has
+
+    void setConnectionState(ConnectionState state) {
+        ConnectionState previous = connectionState.exchange(state);
+        if (previous == state) {
+            return;
+        }
+
+        if (state == ConnectionState::Disconnected) {
+            logInfo("connection to Chrome lost");
+            // Wake every reader blocked on a response, they are not coming
+            messageQueue.notifyAll();
+            eventQueue.notifyAll();
+            failPendingRequests();
+        }
+
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        if (connectionStateListener) {
+            connectionStateListener(state);
+        }
+    }
+
+    void dispatchEvent(const std::string& event, const MessageBuffer& message) {
+        {
+            std::lock_guard<std::mutex> lock(listenerMutex);
+            if (eventListener) {
+                eventListener(event, message.view());
+            }
+        }
+        if (!subscribed) {
+            return;
+        }
+        while (queuedEvents >= MAX_QUEUED_EVENTS && eventQueue.pop().has_value()) {
+            --queuedEvents;
+        }
+        ++queuedEvents;
+        eventQueue.push(message.str());
+    }
+
+    void throwUnlessConnected() {
+        switch (connectionState.load()) {
+            case ConnectionState::Connected:
+                return;
+            case ConnectionState::Draining:
+                throw ChromeDisconnectedError("native messaging host is stopping");
+            case ConnectionState::Disconnected:
+            default:
+                throw ChromeDisconnectedError("native messaging host is disconnected from Chrome");
+        }
+    }
+
+    std::optional<InboundMessage> popResponse(std::chrono::milliseconds timeout) {
+        if (connectionState == ConnectionState::Disconnected) {
+            throwUnlessConnected();
+        }
+
+        auto message = messageQueue.pop(timeout);
+        if (!message.has_value() && connectionState == ConnectionState::Disconnected) {
+            throwUnlessConnected();
+        }
+        return message;
+    }
+
+    void recordRequestSent(const std::string& request) {
+        std::lock_guard<std::mutex> lock(rttMutex);
+        lastRequestSent = std::chrono::steady_clock::now();
+        expireOutstandingRequestsLocked(lastRequestSent);
+        auto& sendTimes = outstandingRequests[request];
+        if (sendTimes.size() >= MAX_OUTSTANDING_PER_REQUEST) {
+            sendTimes.pop_front();
+        }
+        sendTimes.push_back(lastRequestSent);
+    }
+
+    // Forgets requests that will never be matched: past the ceiling, or of a type
+    // the extension stopped answering
+    void expireOutstandingRequestsLocked(std::chrono::steady_clock::time_point now) {
+        for (auto outstanding = outstandingRequests.begin(); outstanding != outstandingRequests.end();) {
+            auto& sendTimes = outstanding->second;
+            while (!sendTimes.empty() && now - sendTimes.front() > RESPONSE_TIMEOUT_CEILING_MILLISECONDS) {
+                sendTimes.pop_front();
+            }
+            outstanding = sendTimes.empty() ? outstandingRequests.erase(outstanding) : std::next(outstanding);
+        }
+    }
+
+    // Responses carry only their type, so they are matched to the oldest outstanding
+    // request of that type. Requests older than the ceiling were given up on and are
+    // discarded rather than matched.
+    void recordResponseReceived(const std::string& response) {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(rttMutex);
+
+        auto outstanding = outstandingRequests.find(response);
+        if (outstanding == outstandingRequests.end()) {
+            return;
+        }
+
+        auto& sendTimes = outstanding->second;
+        while (!sendTimes.empty() && now - sendTimes.front() > RESPONSE_TIMEOUT_CEILING_MILLISECONDS) {
+            sendTimes.pop_front();
+        }
+        if (!sendTimes.empty()) {
+            rttByRequest[response].addSample(std::chrono::duration_cast<std::chrono::microseconds>(now - sendTimes.front()));
+            sendTimes.pop_front();
+        }
+        if (sendTimes.empty()) {
+            outstandingRequests.erase(outstanding);
+        }
+    }
+
+    // Removes and returns the pending request, or std::nullopt if it already
+    // completed (e.g. its response arrived after the deadline)
+    std::optional<PendingRequest> takePendingRequest(uint64_t id) {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        auto pending = pendingRequests.find(id);
+        if (pending == pendingRequests.end()) {
+            return std::nullopt;
+        }
+        PendingRequest request = std::move(pending->second);
+        pendingRequests.erase(pending);
+        timers.cancel(request.timer);
+        if (request.written) {
+            --writtenRequests;
+        }
+        return request;
+    }
+
+    bool isPending(uint64_t id) {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        return pendingRequests.count(id) != 0;
+    }
+
+    // False for a pipelined request that expired or was cancelled while queued, so
+    // it never reaches the extension; otherwise marks it written
+    bool claimForWrite(const json& message) {
+        auto id = message.find("id");
+        if (id == message.end() || !id->is_number_unsigned()) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        auto pending = pendingRequests.find(id->get<uint64_t>());
+        if (pending == pendingRequests.end()) {
+            return false;
+        }
+        if (!pending->second.written) {
+            pending->second.written = true;
+            ++writtenRequests;
+        }
+        return true;
+    }
+
+    static bool isPipelined(const json& message) {
+        return message.contains("id") && message.contains("request");
+    }
+
+    // Writes the held pipelined requests that are still wanted: a lone one as is,
+    // several as {"batch":[...]} frames of up to REQUEST_BATCH_MAX_REQUESTS each
+    void flushHeldRequests(std::vector<json>& held, OutboundFrameBatch& batch) {
+        json requests = json::array();
+        auto writeRequests = [&] {
+            if (requests.size() == 1) {
+                serializeMessage(requests[0], batch);
+            } else if (requests.size() > 1) {
+                json message;
+                message["batch"] = std::move(requests);
+                serializeMessage(message, batch);
+            }
+            requests = json::array();
+        };
+
+        for (auto& message : held) {
+            if (claimForWrite(message)) {
+                requests.push_back(std::move(message));
+            }
+            if (requests.size() == REQUEST_BATCH_MAX_REQUESTS) {
+                writeRequests();
+            }
+        }
+        writeRequests();
+        held.clear();
+    }
+
+    // Hands every entry of a {"response":"batch","batch":[...]} frame to its request
+    // as if it had arrived as a frame of its own: a slice of the frame, with only the
+    // entry's envelope parsed
+    void completeBatch(const std::shared_ptr<const MessageBuffer>& buffer) {
+        auto entries = batchEntries(buffer->view());
+        if (!entries.has_value()) {
+            logError("dropping malformed batch response");
+            return;
+        }
+        for (auto entry : entries.value()) {
+            FrameEnvelope envelope;
+            EnvelopeSaxHandler handler(envelope, [this](uint64_t id) { return isPending(id); });
+            json::sax_parse(entry.begin(), entry.end(), &handler);
+            if (envelope.id.has_value() && !envelope.unwanted) {
+                completePendingRequest(envelope.id.value(), MessageSlice(buffer, entry));
+            }
+        }
+    }
+
+    void completePendingRequest(uint64_t id, const MessageSlice& response) {
+        auto pending = takePendingRequest(id);
+        if (!pending.has_value()) {
+            return;
+        }
+
+        auto rtt = std::chrono::steady_clock::now() - pending->sentAt;
+        {
+            std::lock_guard<std::mutex> lock(rttMutex);
+            rttByRequest[pending->request].addSample(std::chrono::duration_cast<std::chrono::microseconds>(rtt));
+        }
+        pending->callback(ResponseStatus::Ok, response);
+    }
+
+    void expirePendingRequest(uint64_t id) {
+        std::optional<PendingRequest> expired;
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            auto pending = pendingRequests.find(id);
+            if (pending == pendingRequests.end()) {
+                return;
+            }
+            expired = std::move(pending->second);
+            pendingRequests.erase(pending);
+            if (expired->written) {
+                --writtenRequests;
+            }
+        }
+        expired->callback(ResponseStatus::Timeout, MessageSlice());
+    }
+
+    void failPendingRequests() {
+        std::map<uint64_t, PendingRequest> failed;
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            failed.swap(pendingRequests);
+            writtenRequests = 0;
+            for (const auto& pending : failed) {
+                timers.cancel(pending.second.timer);
+            }
+        }
+
+        for (auto& pending : failed) {
+            pending.second.callback(ResponseStatus::Disconnected, MessageSlice());
+        }
+    }
+
+    std::chrono::milliseconds responseTimeoutLocked(const std::string& request) {
+        auto estimator = rttByRequest.find(request);
+        if (estimator == rttByRequest.end()) {
+            return READ_RESPONSE_TIMEOUT_MILLISECONDS;
+        }
+
+        auto estimate = estimator->second.estimate();
+        if (estimate.samples < RESPONSE_TIMEOUT_MIN_SAMPLES) {
+            return READ_RESPONSE_TIMEOUT_MILLISECONDS;
+        }
+
+        // A slow transport (e.g. a busy browser) slows down every request type
+        auto p99 = estimate.p99;
+        auto ping = rttByRequest.find(PING_REQUEST);
+        if (ping != rttByRequest.end()) {
+            auto pingEstimate = ping->second.estimate();
+            if (pingEstimate.samples >= RESPONSE_TIMEOUT_MIN_SAMPLES) {
+                p99 = std::max(p99, pingEstimate.p99);
+            }
+        }
+
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(p99 * RESPONSE_TIMEOUT_P99_FACTOR);
+        return std::clamp(timeout, RESPONSE_TIMEOUT_FLOOR_MILLISECONDS, RESPONSE_TIMEOUT_CEILING_MILLISECONDS);
+    }
+
+    // Wakes up when the link would have been idle for IDLE_PING_INTERVAL_MILLISECONDS
+    // and sends a ping if nothing went out in the meantime
+    void scheduleHeartbeat() {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point due;
+        {
+            std::lock_guard<std::mutex> lock(rttMutex);
+            due = lastRequestSent + IDLE_PING_INTERVAL_MILLISECONDS;
+        }
+        if (due <= now) {
+            due = now + IDLE_PING_INTERVAL_MILLISECONDS;
+        }
+        timers.schedule(due, [this] {
+            if (pingDue()) {
+                json ping;
+                ping["request"] = PING_REQUEST;
+                recordRequestSent(PING_REQUEST);
+                requestQueue.push(ping);
+            }
+            scheduleHeartbeat();
+        });
+    }
+
+    // Send a heartbeat when nothing was sent for a while and no ping is outstanding
+    bool pingDue() {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(rttMutex);
+        if (now - lastRequestSent < IDLE_PING_INTERVAL_MILLISECONDS) {
+            return false;
+        }
+        auto pending = outstandingRequests.find(PING_REQUEST);
+        return pending == outstandingRequests.end() || now - pending->second.back() > RESPONSE_TIMEOUT_CEILING_MILLISECONDS;
+    }
 
     void readHandler() {
         while (!stopRequested) {
-            int message_length;
-            std::cin.read(reinterpret_cast<char*>(&message_length), sizeof(message_length));
-
-            if (std::cin.eof() || std::cin.fail() || message_length <= 0) {
+            uint32_t message_length;
+            if (!readExact(STDIN_FILENO, reinterpret_cast<char*>(&message_length), sizeof(message_length))
+                || message_length == 0 || message_length > MAX_INBOUND_FRAME_BYTES) {
                 logError("failed to read message length");
                 break;
             }
 
-            std::string message;
-            message.resize(message_length);
-            std::cin.read(&message[0], message_length);
+            InboundMessage message;
+            try {
+                message.buffer = MessageBuffer::create(message_length, inMemoryFrameLimit);
+            } catch (const std::exception& ex) {
+                logError("failed to allocate message: " + std::string(ex.what()));
+                break;
+            }
+
+            // Validate and pick out the envelope while the body streams in
+            StreamingFrameSource source(STDIN_FILENO, *message.buffer);
+            EnvelopeSaxHandler handler(message.envelope, [this](uint64_t id) { return isPending(id); });
+            bool parsed = json::sax_parse(source.begin(), source.end(), &handler);
 
-            if (std::cin.eof() || std::cin.fail()) {
+            if (!source.drain() || source.hasFailed()) {
                 logError("failed to read message");
                 break;
             }
 
+            if (message.envelope.unwanted) {
+                continue;
+            }
+
+            if (!parsed) {
+                logError("dropping malformed message: " + handler.errorMessage());
+                continue;
+            }
+
+            if (message.envelope.response == BATCH_RESPONSE) {
+                completeBatch(message.buffer);
+                continue;
+            }
+
+            if (message.envelope.id.has_value()) {
+                completePendingRequest(message.envelope.id.value(), MessageSlice(message.buffer));
+                continue;
+            }
+
+            // Pushed events form their own stream, apart from responses
+            if (!message.envelope.event.empty()) {
+                dispatchEvent(message.envelope.event, *message.buffer);
+                continue;
+            }
+
+            recordResponseReceived(message.envelope.response);
+            if (message.envelope.response == PING_REQUEST) {
+                continue;
+            }
+
             messageQueue.push(message);
         }
+
+        if (!stopRequested) {
+            setConnectionState(ConnectionState::Disconnected);
+        }
     }
 
     void writeHandler() {
+        OutboundFrameBatch batch([this](const std::vector<std::string>& frames) { return writeFrames(frames); },
+                                 WRITE_BATCH_MAX_FRAMES, WRITE_BATCH_BYTE_BUDGET);
+
+        // Pipelined requests waiting to join the next batch frame, and since when
+        std::vector<json> held;
+        auto heldSince = std::chrono::steady_clock::now();
+
+        auto route = [&](json message) {
+            if (!isPipelined(message)) {
+                serializeMessage(message, batch);
+                return;
+            }
+            if (held.empty()) {
+                heldSince = std::chrono::steady_clock::now();
+            }
+            held.push_back(std::move(message));
+        };
+
         while (!stopRequested) {
-            auto result = requestQueue.pop(REQUEST_QUEUE_READ_TIMEOUT_MILLISECONDS);
+            // Expirations run here, between writes, so they never race the batch
+            timers.advance();
+            auto wait = std::min(timers.nextExpiry().value_or(REQUEST_QUEUE_READ_TIMEOUT_MILLISECONDS),
+                                 REQUEST_QUEUE_READ_TIMEOUT_MILLISECONDS);
+            if (!held.empty()) {
+                auto flushAt = heldSince + batchWindow.load();
+                wait = std::min(wait, std::max(std::chrono::milliseconds(0), std::chrono::ceil<std::chrono::milliseconds>(
+                                                                                  flushAt - std::chrono::steady_clock::now())));
+            }
+            auto result = requestQueue.pop(wait);
 
             if (result.has_value()) {
-                std::string request = result.value();
+                // Gather whatever else is already queued so a burst of requests
+                // leaves in a single writev. A lone request is written immediately:
+                // we never wait for more frames to arrive.
+                route(std::move(result.value()));
+                for (auto& message : requestQueue.popBatch(WRITE_BATCH_MAX_FRAMES - 1)) {
+                    route(std::move(message));
+                }
+            }
 
-                json requestJson;
-                requestJson["request"] = request;
-                std::string serializedRequest = requestJson.dump();
+            // Hold pipelined requests only while the extension is busy with earlier
+            // ones, and never beyond the batch window
+            if (!held.empty()
+                && (writtenRequests == 0 || held.size() >= REQUEST_BATCH_MAX_REQUESTS
+                    || std::chrono::steady_clock::now() >= heldSince + batchWindow.load())) {
+                flushHeldRequests(held, batch);
+            }
+            batch.flush();
 
-                int request_length = serializedRequest.size();
-                std::cout.write(reinterpret_cast<const char*>(&request_length), sizeof(request_length));
-                std::cout.write(serializedRequest.c_str(), request_length);
-                std::cout.flush();
+            if (batch.hasFailed()) {
+                setConnectionState(ConnectionState::Disconnected);
+                return;
             }
         }
+
+        // Draining: flush what was accepted before stop()
+        for (auto& message : requestQueue.popBatch(SIZE_MAX)) {
+            route(std::move(message));
+        }
+        flushHeldRequests(held, batch);
+        batch.flush();
+    }
+
+    // Stream the message through the serializer straight into frames
+    void serializeMessage(const json& message, OutboundFrameBatch& batch) {
+        auto adapter = std::make_shared<ChunkingOutputAdapter>(batch, nextChunkId++, MAX_OUTBOUND_FRAME_BYTES);
+        try {
+            nlohmann::detail::serializer<json> serializer(adapter, ' ');
+            serializer.dump(message, false, false, 0);
+            adapter->finish();
+        } catch (const std::exception& ex) {
+            logError("failed to serialize message: " + std::string(ex.what()));
+            adapter->abort();
+        }
+    }
+
+    // Write every frame, each preceded by its native-endian 32-bit length, with as
+    // few writev calls as the kernel allows. Returns false if stdout is unusable.
+    bool writeFrames(const std::vector<std::string>& frames) {
+        std::vector<uint32_t> lengths(frames.size());
+        std::vector<iovec> iov(frames.size() * 2);
+
+        for (size_t i = 0; i < frames.size(); ++i) {
+            lengths[i] = static_cast<uint32_t>(frames[i].size());
+            iov[2 * i].iov_base = &lengths[i];
+            iov[2 * i].iov_len = sizeof(uint32_t);
+            iov[2 * i + 1].iov_base = const_cast<char*>(frames[i].data());
+            iov[2 * i + 1].iov_len = frames[i].size();
+        }
+
+        size_t index = 0;
+        while (index < iov.size()) {
+            int count = static_cast<int>(std::min<size_t>(iov.size() - index, IOV_MAX));
+            ssize_t written = ::writev(STDOUT_FILENO, &iov[index], count);
+
+            if (written == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                logError("failed to write to stdout: " + std::string(strerror(errno)));
+                return false;
+            }
+
+            // Skip fully written buffers, then trim a partially written one
+            size_t remaining = static_cast<size_t>(written);
+            while (index < iov.size() && remaining >= iov[index].iov_len) {
+                remaining -= iov[index].iov_len;
+                ++index;
+            }
+            if (remaining > 0) {
+                iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + remaining;
+                iov[index].iov_len -= remaining;
+            }
+        }
+        return true;
     }
 
     void setIOStreamsToBinary() {
@@ -158,10 +1187,63 @@ bool NativeMessagingHost::isStopRequested() {
     return mImpl->isStopRequested();
 }
 
+NativeMessagingHost::ConnectionState NativeMessagingHost::connectionState() {
+    return mImpl->getConnectionState();
+}
+
+void NativeMessagingHost::setConnectionStateListener(std::function<void(ConnectionState)> listener) {
+    mImpl->setConnectionStateListener(std::move(listener));
+}
+
+void NativeMessagingHost::setEventListener(EventListener listener) {
+    mImpl->setEventListener(std::move(listener));
+}
+
+void NativeMessagingHost::subscribe() {
+    mImpl->subscribe();
+}
+
+std::optional<std::string> NativeMessagingHost::readEvent(std::chrono::milliseconds timeout) {
+    return mImpl->readEvent(timeout);
+}
+
 void NativeMessagingHost::sendRequest(const std::string& request) {
     mImpl->sendRequest(request);
 }
 
+NativeMessagingHost::RequestId NativeMessagingHost::sendRequest(const std::string& request, std::chrono::milliseconds timeout,
+                                                                ResponseCallback callback) {
+    return mImpl->sendRequest(request, timeout, std::move(callback));
+}
+
+bool NativeMessagingHost::cancelRequest(RequestId id) {
+    return mImpl->cancelRequest(id);
+}
+
+void NativeMessagingHost::sendMessage(const nlohmann::json& message) {
+    mImpl->sendMessage(message);
+}
+
 std::optional<std::string> NativeMessagingHost::readResponse(std::chrono::milliseconds timeout) {
     return mImpl->readResponse(timeout);
 }
+
+std::chrono::milliseconds NativeMessagingHost::responseTimeout(const std::string& request) {
+    return mImpl->responseTimeout(request);
+}
+
+std::map<std::string, NativeMessagingHost::RttEstimate> NativeMessagingHost::rttEstimates() {
+    return mImpl->rttEstimates();
+}
+
+std::shared_ptr<const MessageBuffer> NativeMessagingHost::readResponseBuffer(std::chrono::milliseconds timeout) {
+    return mImpl->readResponseBuffer(timeout);
+}
+
+void NativeMessagingHost::setInMemoryFrameLimit(size_t bytes) {
+    mImpl->setInMemoryFrameLimit(bytes);
+}
+
+void NativeMessagingHost::setBatchWindow(std::chrono::microseconds window) {
+    mImpl->setBatchWindow(window);
+}
@@ -2,12 +2,50 @@
 #define NATIVE_MESSAGING_HOST_H
 
 #include <string>
+#include <string_view>
 #include <optional>
 #include <chrono>
 #include <memory>
+#include <map>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+
+#include "MessageBuffer.hpp"
+#include "json.hpp"
+
+// Thrown by NativeMessagingHost once the Chrome port is gone, so callers fail
+// immediately instead of waiting out their response timeouts
+class ChromeDisconnectedError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
 
 class NativeMessagingHost {
 public:
+    // Connected: requests flow normally.
+    // Draining: stop() was called, queued requests are still flushed but new ones are rejected.
+    // Disconnected: stdin/stdout is closed, every request fails with ChromeDisconnectedError.
+    enum class ConnectionState { Connected, Draining, Disconnected };
+
+    // Observed round trips for one request type
+    struct RttEstimate {
+        size_t samples;
+        std::chrono::microseconds p50;
+        std::chrono::microseconds p99;
+        std::chrono::milliseconds timeout;   // What responseTimeout() currently returns
+    };
+
+    enum class ResponseStatus { Ok, Timeout, Disconnected, Cancelled };
+
+    using RequestId = uint64_t;
+
+    // Completion of a request sent with an id. response is the extension's answer when
+    // status is Ok, as a slice of the received frame (one entry of a batch frame), and
+    // empty otherwise. The slice keeps the frame alive; copy only what must outlive it.
+    using ResponseCallback = std::function<void(ResponseStatus status, const MessageSlice& response)>;
+
     // Singleton pattern: Get the single instance of the NativeMessagingHost
     static NativeMessagingHost& getInstance();
 
@@ -17,10 +55,77 @@ public:
 
     bool isStopRequested();
 
+    ConnectionState connectionState();
+
+    // Called from the host's I/O threads whenever the connection state changes
+    void setConnectionStateListener(std::function<void(ConnectionState)> listener);
+
+    // Called on the host's read thread for every {"event":name,...} frame the
+    // extension pushes on its own, with a view of the frame's text that is only valid
+    // during the call; must not block. Event frames never reach readResponse.
+    using EventListener = std::function<void(const std::string& event, std::string_view message)>;
+    void setEventListener(EventListener listener);
+
+    // Sends {"request":"subscribe"}: from then on the extension pushes
+    // {"event":"tabChanged","reason":...,"tabId":...,"url":...} whenever the active
+    // tab may have changed, instead of the host having to poll for it. Throws
+    // ChromeDisconnectedError unless connected.
+    void subscribe();
+
+    // Next pushed event frame once subscribed, std::nullopt on timeout. This stream
+    // is separate from readResponse; if nobody reads it only the most recent events
+    // are kept. Throws ChromeDisconnectedError as soon as the connection is lost.
+    std::optional<std::string> readEvent(std::chrono::milliseconds timeout = READ_RESPONSE_TIMEOUT_MILLISECONDS);
+
+    // Throws ChromeDisconnectedError unless the host is connected
     void sendRequest(const std::string& request);
 
+    // Pipelined variant: sends {"request":request,"id":N,"timeoutMs":timeout} and
+    // returns N at once. The extension echoes "id", so any number of requests may be
+    // outstanding and be answered in any order, and may use "timeoutMs" to skip work
+    // it could not finish in time. callback runs exactly once, on one of the host's
+    // I/O threads, so it must not block. Throws ChromeDisconnectedError unless connected.
+    RequestId sendRequest(const std::string& request, std::chrono::milliseconds timeout, ResponseCallback callback);
+
+    // Completes a pipelined request with ResponseStatus::Cancelled. A request still
+    // queued is never written; one the extension already has is followed by
+    // {"cancel":N} so it can stop working on it, and its late response is dropped.
+    // Returns false if the request already completed.
+    bool cancelRequest(RequestId id);
+
+    // Send an arbitrary message to the extension. Messages that serialize to more than
+    // Chrome's 1 MB limit are streamed as a sequence of chunk frames and reassembled
+    // by the service worker.
+    void sendMessage(const nlohmann::json& message);
+
+    // Returns std::nullopt on timeout. Throws ChromeDisconnectedError as soon as the
+    // connection is lost, including while waiting.
     std::optional<std::string> readResponse(std::chrono::milliseconds timeout = READ_RESPONSE_TIMEOUT_MILLISECONDS);
-    
+
+    // Timeout to wait for the response to a request of the given type. Derived from the
+    // observed p99 round trip of that type (or of the idle ping, whichever is slower)
+    // with floor and ceiling; READ_RESPONSE_TIMEOUT_MILLISECONDS until enough samples exist.
+    std::chrono::milliseconds responseTimeout(const std::string& request);
+
+    // Current round-trip estimates per request type, for diagnostics. The idle
+    // heartbeat is listed as "ping".
+    std::map<std::string, RttEstimate> rttEstimates();
+
+    // Same as readResponse, but hands out the received frame itself instead of a copy.
+    // Large frames are memfd-backed, see setInMemoryFrameLimit.
+    std::shared_ptr<const MessageBuffer> readResponseBuffer(std::chrono::milliseconds timeout = READ_RESPONSE_TIMEOUT_MILLISECONDS);
+
+    // Frames from the extension larger than this many bytes are streamed into a
+    // memfd-backed buffer instead of being held on the heap
+    void setInMemoryFrameLimit(size_t bytes);
+
+    // Pipelined requests are sent to the extension as {"batch":[...]} frames, answered
+    // by one {"response":"batch","batch":[...]} frame. While earlier requests are
+    // still with the extension, new ones are held for up to this long so they join
+    // the next batch; when the extension is idle they leave at once. Zero only
+    // combines requests that are queued at the same moment.
+    void setBatchWindow(std::chrono::microseconds window);
+
 private:
     static constexpr std::chrono::milliseconds READ_RESPONSE_TIMEOUT_MILLISECONDS = std::chrono::milliseconds(2000);
     
@@ -0,0 +1,77 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <array>
+#include <string_view>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+// Minimal perfect hash over a fixed set of strings, built entirely at compile time:
+// the constructor searches for a seed that sends every key to its own slot, so a
+// lookup costs one FNV-1a pass and one string compare. Use it for constexpr tables
+// only; a key set without a seed in range fails to compile.
+template <size_t N>
+class PerfectHash {
+public:
+    static_assert(N > 0, "PerfectHash needs at least one key");
+
+    constexpr explicit PerfectHash(const std::array<std::string_view, N>& keys)
+        : keys_(keys), seed_(findSeed(keys)), slots_() {
+        for (size_t i = 0; i < N; ++i) {
+            slots_[slotOf(keys_[i], seed_)] = i;
+        }
+    }
+
+    // Position of key in the array given to the constructor, or N if it is not one of them
+    constexpr size_t find(std::string_view key) const {
+        size_t index = slots_[slotOf(key, seed_)];
+        return keys_[index] == key ? index : N;
+    }
+
+    constexpr std::string_view key(size_t index) const {
+        return keys_[index];
+    }
+
+    static constexpr size_t size() {
+        return N;
+    }
+
+private:
+    static constexpr uint32_t MAX_SEED = 1u << 16;
+
+    static constexpr uint32_t hash(std::string_view key, uint32_t seed) {
+        uint32_t value = 2166136261u ^ seed;
+        for (char c : key) {
+            value ^= static_cast<uint8_t>(c);
+            value *= 16777619u;
+        }
+        return value;
+    }
+
+    static constexpr size_t slotOf(std::string_view key, uint32_t seed) {
+        return hash(key, seed) % N;
+    }
+
+    static constexpr uint32_t findSeed(const std::array<std::string_view, N>& keys) {
+        for (uint32_t seed = 0; seed < MAX_SEED; ++seed) {
+            std::array<bool, N> used{};
+            bool collision = false;
+            for (size_t i = 0; i < N && !collision; ++i) {
+                size_t slot = slotOf(keys[i], seed);
+                collision = used[slot];
+                used[slot] = true;
+            }
+            if (!collision) {
+                return seed;
+            }
+        }
+        throw std::logic_error("no perfect hash seed for this key set");
+    }
+
+    std::array<std::string_view, N> keys_;
+    uint32_t seed_;
+    std::array<size_t, N> slots_;
+};
+
+#endif  // PERFECT_HASH_H
@@ -0,0 +1,77 @@
+#ifndef PIPE_ENCODING_H
+#define PIPE_ENCODING_H
+
+#include <string>
+#include <optional>
+#include <cstdint>
+
+#include "json.hpp"
+
+// Payload encodings a pipe connection can negotiate. Every connection starts out
+// with text JSON; a client switches by sending a Handshake frame whose (JSON)
+// payload is {"encoding":"msgpack"} or {"encoding":"cbor"}. The host answers with a
+// JSON Handshake frame naming the encoding now in effect, and every later Request,
+// Response, Event and Error payload on that connection uses it. Handshake frames
+// themselves are always JSON.
+enum class PipeEncoding : uint8_t {
+    Json,
+    MessagePack,
+    Cbor,
+};
+
+inline const char* pipeEncodingName(PipeEncoding encoding) {
+    switch (encoding) {
+        case PipeEncoding::MessagePack:
+            return "msgpack";
+        case PipeEncoding::Cbor:
+            return "cbor";
+        case PipeEncoding::Json:
+        default:
+            return "json";
+    }
+}
+
+inline std::optional<PipeEncoding> pipeEncodingFromName(const std::string& name) {
+    if (name == "json") {
+        return PipeEncoding::Json;
+    }
+    if (name == "msgpack") {
+        return PipeEncoding::MessagePack;
+    }
+    if (name == "cbor") {
+        return PipeEncoding::Cbor;
+    }
+    return std::nullopt;
+}
+
+inline std::string encodePipePayload(const nlohmann::json& value, PipeEncoding encoding) {
+    std::string payload;
+    switch (encoding) {
+        case PipeEncoding::MessagePack:
+            nlohmann::json::to_msgpack(value, nlohmann::detail::output_adapter<char>(payload));
+            break;
+        case PipeEncoding::Cbor:
+            nlohmann::json::to_cbor(value, nlohmann::detail::output_adapter<char>(payload));
+            break;
+        case PipeEncoding::Json:
+        default:
+            payload = value.dump();
+            break;
+    }
+    return payload;
+}
+
+// Throws nlohmann::json::exception (parse_error for truncated or invalid input)
+inline nlohmann::json decodePipePayload(const std::string& payload, PipeEncoding encoding) {
+    switch (encoding) {
+        case PipeEncoding::MessagePack:
+            return nlohmann::json::from_msgpack(payload);
+        case PipeEncoding::Cbor:
+            return nlohmann::json::from_cbor(payload);
+        case PipeEncoding::Json:
+        default:
+            return nlohmann::json::parse(payload);
+    }
+}
+
+#endif  // PIPE_ENCODING_H
@@ -0,0 +1,84 @@
+#ifndef PIPE_OUTPUT_QUEUE_H
+#define PIPE_OUTPUT_QUEUE_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+#include <sys/uio.h>
+
+// Immutable bytes handed to a transport. A frame written to many clients is one
+// buffer that every client's output queue references.
+using PipeBuffer = std::shared_ptr<const std::string>;
+
+// Output a transport holds for one client: the queued buffers themselves, of which
+// only the first may be partly written, so queueing never copies bytes and a flush
+// hands them all to one writev.
+class PipeOutputQueue {
+public:
+    // Buffers described per writev; far below IOV_MAX
+    static constexpr int MAX_IOVECS = 64;
+
+    void push(PipeBuffer buffer) {
+        if (!buffer || buffer->empty()) {
+            return;
+        }
+        bytes += buffer->size();
+        buffers.push_back(std::move(buffer));
+    }
+
+    // Bytes not written yet
+    size_t size() const { return bytes; }
+    bool empty() const { return bytes == 0; }
+
+    void clear() {
+        buffers.clear();
+        offset = 0;
+        bytes = 0;
+    }
+
+    // Describes the unwritten bytes of up to count buffers; returns how many iov
+    // entries it filled
+    int fill(iovec* iov, int count) const {
+        int filled = 0;
+        size_t skip = offset;
+        for (auto buffer = buffers.begin(); buffer != buffers.end() && filled < count; ++buffer, ++filled) {
+            iov[filled].iov_base = const_cast<char*>((*buffer)->data() + skip);
+            iov[filled].iov_len = (*buffer)->size() - skip;
+            skip = 0;
+        }
+        return filled;
+    }
+
+    // Unwritten bytes of the first buffer, for transports that copy rather than write
+    std::string_view front() const {
+        if (buffers.empty()) {
+            return std::string_view();
+        }
+        return std::string_view(*buffers.front()).substr(offset);
+    }
+
+    // Drops written bytes from the front, releasing buffers written completely
+    void consume(size_t written) {
+        bytes -= written;
+        while (written > 0) {
+            size_t remaining = buffers.front()->size() - offset;
+            if (written < remaining) {
+                offset += written;
+                return;
+            }
+            written -= remaining;
+            buffers.pop_front();
+            offset = 0;
+        }
+    }
+
+private:
+    std::deque<PipeBuffer> buffers;
+    size_t offset{0};   // Bytes of the first buffer already written
+    size_t bytes{0};
+};
+
+#endif  // PIPE_OUTPUT_QUEUE_H
@@ -0,0 +1,142 @@
+#ifndef PIPE_PROTOCOL_H
+#define PIPE_PROTOCOL_H
+
+#include <string>
+#include <optional>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+// Wire format of the pipe protocol. Every message is a fixed 12-byte little-endian
+// header followed by `length` bytes of payload:
+//
+//   offset 0  uint32  length     payload size in bytes
+//   offset 4  uint8   type       PipeMessageType
+//   offset 5  uint8   flags      PipeFrameFlags bits
+//   offset 6  uint16  version    PIPE_PROTOCOL_VERSION
+//   offset 8  uint32  requestId  chosen by the client, echoed in the response
+enum class PipeMessageType : uint8_t {
+    Request = 1,    // Client to host
+    Response = 2,   // Host to client, answers the request with the same requestId
+    Event = 3,      // Host to client, unsolicited (requestId 0)
+    Error = 4,      // Host to client, the request with this requestId could not be handled
+    Handshake = 5,  // Connection setup: {"pid":1234} on the dual-FIFO transport, payload
+                    // encoding negotiation (PipeEncoding.hpp), always JSON
+};
+
+namespace PipeFrameFlags {
+    constexpr uint8_t NONE = 0;
+}
+
+constexpr uint16_t PIPE_PROTOCOL_VERSION = 1;
+constexpr size_t PIPE_FRAME_HEADER_SIZE = 12;
+// Anything larger is treated as a corrupt header
+constexpr uint32_t PIPE_FRAME_MAX_PAYLOAD = 16 * 1024 * 1024;
+
+struct PipeFrameHeader {
+    uint32_t length{0};
+    PipeMessageType type{PipeMessageType::Request};
+    uint8_t flags{PipeFrameFlags::NONE};
+    uint16_t version{PIPE_PROTOCOL_VERSION};
+    uint32_t requestId{0};
+};
+
+struct PipeFrame {
+    PipeFrameHeader header;
+    std::string payload;
+};
+
+class PipeProtocolError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// The header of a frame carrying length bytes of payload, for writing it in front of
+// a payload buffer that is shared with other frames
+inline std::string encodePipeFrameHeader(PipeMessageType type, uint32_t requestId, size_t length,
+                                         uint8_t flags = PipeFrameFlags::NONE) {
+    char header[PIPE_FRAME_HEADER_SIZE] = {
+        static_cast<char>(length), static_cast<char>(length >> 8),
+        static_cast<char>(length >> 16), static_cast<char>(length >> 24),
+        static_cast<char>(type), static_cast<char>(flags),
+        static_cast<char>(PIPE_PROTOCOL_VERSION), static_cast<char>(PIPE_PROTOCOL_VERSION >> 8),
+        static_cast<char>(requestId), static_cast<char>(requestId >> 8),
+        static_cast<char>(requestId >> 16), static_cast<char>(requestId >> 24),
+    };
+    return std::string(header, PIPE_FRAME_HEADER_SIZE);
+}
+
+inline std::string encodePipeFrame(PipeMessageType type, uint32_t requestId, const std::string& payload,
+                                   uint8_t flags = PipeFrameFlags::NONE) {
+    std::string frame = encodePipeFrameHeader(type, requestId, payload.size(), flags);
+    frame.append(payload);
+    return frame;
+}
+
+// Incremental decoder: feed() whatever a read returned, then call next() until it
+// returns std::nullopt. Partial frames stay buffered until the rest arrives.
+class PipeFrameDecoder {
+public:
+    void feed(const char* data, size_t size) {
+        buffer_.append(data, size);
+    }
+
+    // Throws PipeProtocolError on a header that cannot be valid; the stream cannot be
+    // resynchronised after that and should be reset.
+    std::optional<PipeFrame> next() {
+        if (buffer_.size() - offset_ < PIPE_FRAME_HEADER_SIZE) {
+            compact();
+            return std::nullopt;
+        }
+
+        const auto* bytes = reinterpret_cast<const unsigned char*>(buffer_.data() + offset_);
+        PipeFrameHeader header;
+        header.length = readUint32(bytes);
+        header.type = static_cast<PipeMessageType>(bytes[4]);
+        header.flags = bytes[5];
+        header.version = static_cast<uint16_t>(bytes[6] | (bytes[7] << 8));
+        header.requestId = readUint32(bytes + 8);
+
+        if (header.version != PIPE_PROTOCOL_VERSION) {
+            throw PipeProtocolError("unsupported pipe protocol version " + std::to_string(header.version));
+        }
+        if (header.length > PIPE_FRAME_MAX_PAYLOAD) {
+            throw PipeProtocolError("pipe frame too large: " + std::to_string(header.length) + " bytes");
+        }
+
+        if (buffer_.size() - offset_ < PIPE_FRAME_HEADER_SIZE + header.length) {
+            compact();
+            return std::nullopt;
+        }
+
+        PipeFrame frame;
+        frame.header = header;
+        frame.payload.assign(buffer_, offset_ + PIPE_FRAME_HEADER_SIZE, header.length);
+        offset_ += PIPE_FRAME_HEADER_SIZE + header.length;
+        return frame;
+    }
+
+    void reset() {
+        buffer_.clear();
+        offset_ = 0;
+    }
+
+private:
+    static uint32_t readUint32(const unsigned char* bytes) {
+        return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8)
+             | (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    }
+
+    // Drop consumed bytes once no complete frame is left
+    void compact() {
+        if (offset_ > 0) {
+            buffer_.erase(0, offset_);
+            offset_ = 0;
+        }
+    }
+
+    std::string buffer_;
+    size_t offset_{0};
+};
+
+#endif  // PIPE_PROTOCOL_H
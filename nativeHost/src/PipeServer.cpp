@@ -3,7 +3,21 @@
 
 #include <thread>
 #include <atomic>
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <mutex>
 #include "ConcurrentQueue.hpp"
+#include "PipeProtocol.hpp"
+#include "PipeEncoding.hpp"
+#include "PipeServerInterface.h"
+#include "SharedMessage.hpp"
+#include "UnixSocketPipeServer.h"
+#include "DualFifoPipeServer.h"
+#include "SharedMemoryPipeServer.h"
+#include "IoUringPipeServer.h"
 
 using json = nlohmann::json; 
 
@@ -19,17 +33,6 @@ namespace {
     }    
 }
 
-class PipeServerInterface {
-public:
-    virtual ~PipeServerInterface() {};
-
-    virtual void start() = 0;
-    virtual void stop() = 0;
-    virtual std::string readData() const = 0;
-    virtual void writeData(const std::string& data) const = 0;
-};
-
-
 #ifdef _WIN32
 class WindowsPipeServer : public PipeServerInterface {
 public:
@@ -39,7 +42,10 @@ public:
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 
 #include <iostream>
@@ -50,10 +56,15 @@ public:
 class LinuxPipeServer : public PipeServerInterface {
 public:
     ~LinuxPipeServer() override {
-        // No explicit logic in the destructor
+        for (int* descriptor : {&fd, &wakeupFd}) {
+            if (*descriptor != -1) {
+                close(*descriptor);
+            }
+        }
     }
 
-    LinuxPipeServer(const std::string& pipeName) : PipeServerInterface(), pipeName(pipeName), fd(0) {}
+    LinuxPipeServer(const std::string& pipeName, size_t pipeBufferSize)
+        : PipeServerInterface(), pipeName(pipeName), pipeBufferSize(pipeBufferSize) {}
 
     void start() override {
         
@@ -66,57 +77,235 @@ public:
             throw std::runtime_error("Error creating named pipe '" + pipeName + "': " + std::string(strerror(errno)));
         }
 
-        fd = open(pipeName.c_str(), O_RDWR);
+        // Opened for reading and writing so it never reports EOF between clients;
+        // nonblocking so neither direction can wedge a thread
+        fd = open(pipeName.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
         if (fd == -1) {
             throw std::runtime_error("Error opening named pipe '" + pipeName + "': " + std::string(strerror(errno)));
         }
+
+        if (pipeBufferSize > 0 && fcntl(fd, F_SETPIPE_SZ, static_cast<int>(pipeBufferSize)) == -1) {
+            logError("Error setting pipe buffer size of '" + pipeName + "': " + std::string(strerror(errno)));
+        }
+
+        wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeupFd == -1) {
+            throw std::runtime_error("Error creating eventfd: " + std::string(strerror(errno)));
+        }
     }
 
     void stop() override {
-        if (close(fd) == -1) {
-            throw std::runtime_error("Error closing named pipe '" + pipeName + "': " + std::string(strerror(errno)));
+        {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            pendingOutput.clear();
+        }
+
+        if (wakeupFd != -1) {
+            close(wakeupFd);
+            wakeupFd = -1;
         }
 
-        if (unlink(pipeName.c_str()) == -1) {
+        if (fd != -1) {
+            int result = close(fd);
+            fd = -1;
+            if (result == -1) {
+                throw std::runtime_error("Error closing named pipe '" + pipeName + "': " + std::string(strerror(errno)));
+            }
+        }
+
+        if (unlink(pipeName.c_str()) == -1 && errno != ENOENT) {
             throw std::runtime_error("Error unlinking named pipe '" + pipeName + "': " + std::string(strerror(errno)));
         }
     }
 
-    std::string readData() const override {
-        char buffer[1025]; // Extra space for null terminator
-        ssize_t bytesRead = read(fd, buffer, sizeof(buffer) - 1);
+    // Waits at most READ_POLL_TIMEOUT_MILLISECONDS for input, output space or a
+    // wakeup, so the receive thread always gets back to check for a stop request
+    std::vector<PipeClientData> readData() override {
+        std::vector<PipeClientData> events;
+        if (fd == -1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(READ_POLL_TIMEOUT_MILLISECONDS));
+            return events;
+        }
+
+        // Whoever writes to the FIFO is one and the same logical client
+        if (!clientAnnounced) {
+            clientAnnounced = true;
+            events.push_back(PipeClientData{PipeClientData::Kind::Connected, FIFO_CLIENT, std::string()});
+        }
+
+        bool wantWrite;
+        {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            wantWrite = !pendingOutput.empty();
+        }
+
+        pollfd descriptors[2] = {};
+        descriptors[0].fd = fd;
+        descriptors[0].events = POLLIN | (wantWrite ? POLLOUT : 0);
+        descriptors[1].fd = wakeupFd;
+        descriptors[1].events = POLLIN;
+
+        int count = poll(descriptors, 2, READ_POLL_TIMEOUT_MILLISECONDS);
+        if (count == -1) {
+            if (errno == EINTR) {
+                return events;
+            }
+            throw std::runtime_error("Error polling named pipe '" + pipeName + "': " + std::string(strerror(errno)));
+        }
+
+        if (descriptors[1].revents & POLLIN) {
+            eventfd_t value;
+            eventfd_read(wakeupFd, &value);
+        }
+
+        if (descriptors[0].revents & POLLOUT) {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            flushPendingLocked();
+        }
+
+        if (descriptors[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            std::string buffer;
+            while (true) {
+                size_t offset = buffer.size();
+                buffer.resize(offset + READ_BUFFER_SIZE);
+                ssize_t bytesRead = read(fd, &buffer[offset], READ_BUFFER_SIZE);
+
+                if (bytesRead > 0) {
+                    buffer.resize(offset + static_cast<size_t>(bytesRead));
+                    continue;
+                }
+
+                buffer.resize(offset);
+                if (bytesRead == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (bytesRead == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    throw std::runtime_error("Error reading from named pipe '" + pipeName + "': " + std::string(strerror(errno)));
+                }
+                break;
+            }
+
+            if (!buffer.empty()) {
+                events.push_back(PipeClientData{PipeClientData::Kind::Data, FIFO_CLIENT, std::move(buffer)});
+            }
+        }
+        return events;
+    }
+
+    // Never blocks: whatever the pipe cannot take right now is kept and flushed by
+    // readData() once the pipe becomes writable again
+    void writeData(PipeClientId, std::initializer_list<PipeBuffer> buffers) override {
+        bool armWrite = false;
+        {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            if (fd == -1) {
+                return;
+            }
+
+            size_t size = 0;
+            for (const auto& buffer : buffers) {
+                size += buffer->size();
+            }
+            if (pendingOutput.size() + size > MAX_PENDING_OUTPUT) {
+                // A FIFO cannot drop its reader, so drop the backlog instead
+                logError("Named pipe '" + pipeName + "' is not being read, discarding " +
+                         std::to_string(pendingOutput.size()) + " pending bytes");
+                pendingOutput.clear();
+            }
+
+            bool wasEmpty = pendingOutput.empty();
+            for (const auto& buffer : buffers) {
+                pendingOutput.push(buffer);
+            }
+            flushPendingLocked();
+            armWrite = wasEmpty && !pendingOutput.empty();
+        }
 
-        if (bytesRead == -1) {
-            throw std::runtime_error("Error reading from named pipe '" + pipeName + "': " + std::string(strerror(errno)));
+        // Let the receive thread start polling for POLLOUT
+        if (armWrite) {
+            wakeup();
         }
+    }
 
-        buffer[bytesRead] = '\0'; // Null-terminate the string
-        return std::string(buffer);
+    void closeClient(PipeClientId) override {
+        // A FIFO cannot be closed for one client, the decoder is simply reset
     }
 
-    void writeData(const std::string& data) const override {
-        ssize_t bytesWritten = write(fd, data.c_str(), data.size());
+    size_t outputBacklog(PipeClientId) override {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        return pendingOutput.size();
+    }
 
-        if (bytesWritten == -1) {
-            throw std::runtime_error("Error writing to named pipe '" + pipeName + "': " + std::string(strerror(errno)));
+    void wakeup() override {
+        if (wakeupFd != -1) {
+            eventfd_write(wakeupFd, 1);
         }
     }
 
 private:
+    void flushPendingLocked() {
+        while (!pendingOutput.empty()) {
+            iovec iov[PipeOutputQueue::MAX_IOVECS];
+            int count = pendingOutput.fill(iov, PipeOutputQueue::MAX_IOVECS);
+            ssize_t bytesWritten = writev(fd, iov, count);
+
+            if (bytesWritten == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    logError("Error writing to named pipe '" + pipeName + "': " + std::string(strerror(errno)));
+                    pendingOutput.clear();
+                    return;
+                }
+                break;
+            }
+            pendingOutput.consume(static_cast<size_t>(bytesWritten));
+        }
+    }
+
+    // A full pipe buffer, so one read picks up every frame that is waiting
+    static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+    // Upper bound on how long stop() waits for the receive thread
+    static constexpr int READ_POLL_TIMEOUT_MILLISECONDS = 1000;
+    static constexpr size_t MAX_PENDING_OUTPUT = 8 * 1024 * 1024;
+    static constexpr PipeClientId FIFO_CLIENT = 1;
     std::string pipeName;
-    int fd;
+    size_t pipeBufferSize;
+    int fd{-1};
+    int wakeupFd{-1};
+    bool clientAnnounced{false};
+    std::mutex outputMutex;
+    PipeOutputQueue pendingOutput;
 };
 
-
 #endif
 
 class PipeServerImpl {
 public:
-    PipeServerImpl(const std::string& pipeName):stopRequested(false) {
+    PipeServerImpl(const std::string& pipeName, const PipeServerOptions& options):stopRequested(false) {
         #ifdef _WIN32
+            (void)options;
             mInterface = std::make_unique<WindowsPipeServer>(pipeName);
         #else
-            mInterface = std::make_unique<LinuxPipeServer>(pipeName);
+            switch (options.transport) {
+                case PipeTransport::UnixSocket:
+                    mInterface = std::make_unique<UnixSocketPipeServer>(pipeName);
+                    break;
+                case PipeTransport::DualFifo:
+                    mInterface = std::make_unique<DualFifoPipeServer>(pipeName, options.pipeBufferSize);
+                    break;
+                case PipeTransport::SharedMemory:
+                    mInterface = std::make_unique<SharedMemoryPipeServer>(pipeName, options.ringCapacity);
+                    break;
+                case PipeTransport::IoUring:
+                    mInterface = createIoUringPipeServer(pipeName);
+                    break;
+                case PipeTransport::Fifo:
+                default:
+                    mInterface = std::make_unique<LinuxPipeServer>(pipeName, options.pipeBufferSize);
+                    break;
+            }
         #endif
     }
 
@@ -139,6 +328,7 @@ public:
 
         sendQueue.notifyAll();
         receiveQueue.notifyAll();
+        mInterface->wakeup();
 
         if (sendThread.joinable()) {
             sendThread.join();
@@ -157,26 +347,165 @@ public:
         logInfo("STOP end");
     }
 
-    void sendResponse(const nlohmann::json& response) {
-        sendQueue.push(response);
+    void sendResponse(PipeClientId clientId, uint32_t requestId, SharedMessagePtr response) {
+        sendQueue.push(OutgoingMessage{PipeMessageType::Response, clientId, requestId, std::move(response)});
     }
-        
-    std::optional<nlohmann::json> readRequest(std::chrono::milliseconds timeout) {
+
+    void sendEvent(const nlohmann::json& event) {
+        sendQueue.push(OutgoingMessage{PipeMessageType::Event, BROADCAST, 0, makeSharedMessage(event)});
+    }
+
+    // Builds the event frame once; every subscriber queue and the last-value cache
+    // hold the same message
+    void publish(const std::string& topic, const json& event) {
+        json body;
+        body["topic"] = topic;
+        body["data"] = event;
+        auto message = std::make_shared<QueuedMessage>(
+            OutgoingMessage{PipeMessageType::Event, SUBSCRIBERS, 0, makeSharedMessage(std::move(body))}, topic, ++publishedEvents);
+        {
+            std::lock_guard<std::mutex> lock(topicsMutex);
+            lastValues[topic] = message;
+            auto topicClients = topicSubscribers.find(topic);
+            if (topicClients == topicSubscribers.end()) {
+                return;
+            }
+            for (PipeClientId client : topicClients->second) {
+                enqueueLocked(subscribers[client], message);
+            }
+        }
+        wakeSendThread();
+    }
+
+    bool hasSubscribers(const std::string& topic) {
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        return topicSubscribers.count(topic) != 0;
+    }
+
+    void setDisconnectListener(std::function<void(PipeClientId)> listener) {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        disconnectListener = std::move(listener);
+    }
+
+    json topicStatistics() {
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        json statistics;
+        statistics["subscribers"] = json::object();
+        for (const auto& topic : topicSubscribers) {
+            statistics["subscribers"][topic.first] = topic.second.size();
+        }
+        size_t queued = 0;
+        for (const auto& subscriber : subscribers) {
+            queued += subscriber.second.queue.size();
+        }
+        statistics["queued"] = queued;
+        statistics["dropped"] = droppedEvents;
+        statistics["patches"] = patchesSent;
+        statistics["disconnected"] = overflowDisconnects;
+        return statistics;
+    }
+
+    std::optional<PipeRequest> readRequest(std::chrono::milliseconds timeout) {
         return receiveQueue.pop(timeout);
-    }    
+    }
 
 
     ~PipeServerImpl() {
 
     }
 private:
+    // Client id used for messages that go to every connected client
+    static constexpr PipeClientId BROADCAST = 0;
+    // Client id of the send queue entry telling the send thread that subscriber
+    // queues have messages; the messages themselves stay in those queues
+    static constexpr PipeClientId SUBSCRIBERS = ~PipeClientId(0);
+
+    // body is shared with whoever else it answers or goes to; frames only add their
+    // own header in front of its payload
+    struct OutgoingMessage {
+        PipeMessageType type;
+        PipeClientId clientId;
+        uint32_t requestId;
+        SharedMessagePtr body;
+    };
+
+    // A message in subscriber queues, shared by every queue holding it and by the
+    // last-value cache. Its body is serialized once per payload encoding, so fan-out
+    // costs one serialization per encoding in use, not one per client.
+    struct QueuedMessage {
+        explicit QueuedMessage(OutgoingMessage message, std::string topic = std::string(), uint64_t sequence = 0)
+            : message(std::move(message)), topic(std::move(topic)), sequence(sequence) {}
+
+        // {"topic","patch"}: the RFC 6902 patch turning base's data into this one's.
+        // Delta subscribers that last got the same base share it.
+        const std::shared_ptr<QueuedMessage>& patchFrom(const QueuedMessage& base) {
+            auto found = patches.find(base.sequence);
+            if (found == patches.end()) {
+                json body;
+                body["topic"] = topic;
+                body["patch"] = json::diff(base.message.body->value()["data"], message.body->value()["data"]);
+                found = patches.emplace(base.sequence, std::make_shared<QueuedMessage>(
+                    OutgoingMessage{PipeMessageType::Event, SUBSCRIBERS, 0, makeSharedMessage(std::move(body))},
+                    topic, sequence)).first;
+            }
+            return found->second;
+        }
+
+        const OutgoingMessage message;
+        const std::string topic;     // Empty for subscription replies
+        const uint64_t sequence;     // Order of publication, 0 for subscription replies
+        std::map<uint64_t, std::shared_ptr<QueuedMessage>> patches;   // By base sequence, send thread only
+    };
+
+    using QueuedMessagePtr = std::shared_ptr<QueuedMessage>;
+
+    // What a subscriber's queue does with a new event when it is full
+    enum class DropPolicy {
+        DropOldest,   // Discard the oldest queued event: the client sees current state late rather than stale state
+        DropNewest,   // Discard the new event: the client sees every event up to the gap
+        Disconnect,   // Drop the client: it must not miss events
+    };
+
+    // What a delta subscriber last received on a topic, the base of the next patch
+    struct DeltaState {
+        QueuedMessagePtr base;
+        unsigned patchesSinceSnapshot{0};
+    };
+
+    struct Subscriber {
+        std::set<std::string> topics;
+        std::deque<QueuedMessagePtr> queue;   // Replies and events the send thread has not written yet
+        size_t capacity{DEFAULT_SUBSCRIBER_QUEUE};
+        DropPolicy policy{DropPolicy::DropOldest};
+        bool overflowed{false};   // Hit the Disconnect policy, the send thread drops the client
+        bool delta{false};        // Wants patches against the previous event of a topic
+        std::map<std::string, DeltaState> sent;   // Per topic
+    };
+
     void sendThreadFunction() {
         while (!stopRequested) {
             try {
-                auto result = sendQueue.pop(REQUEST_QUEUE_READ_TIMEOUT_MILLISECONDS);
+                // Backlogged subscribers are retried as their clients catch up
+                auto result = sendQueue.pop(subscribersBacklogged ? SUBSCRIBER_RETRY_INTERVAL
+                                                                  : REQUEST_QUEUE_READ_TIMEOUT_MILLISECONDS);
                 if (result.has_value()) {
-                    std::string serializedData = result.value().dump();
-                    mInterface->writeData(serializedData);
+                    auto& message = result.value();
+
+                    if (message.clientId == SUBSCRIBERS) {
+                        drainSubscribers();
+                    } else if (message.type == PipeMessageType::Handshake) {
+                        // Everything written after this reply uses the new encoding
+                        writeMessage(message.clientId, message, PipeEncoding::Json);
+                        setClientEncoding(message.clientId, message.body->value());
+                    } else if (message.clientId != BROADCAST) {
+                        writeMessage(message.clientId, message, clientEncoding(message.clientId));
+                    } else {
+                        for (const auto& client : connectedClients()) {
+                            writeMessage(client.first, message, client.second);
+                        }
+                    }
+                } else if (subscribersBacklogged) {
+                    drainSubscribers();
                 }
             } catch (const std::exception& ex) {
                 logError("Exception: " + std::string(ex.what()));
@@ -187,28 +516,402 @@ private:
     void receiveThreadFunction() {
         while (!stopRequested) {
             try {
-                auto buffer = mInterface->readData();
-                json receivedData = json::parse(buffer);
-
-                receiveQueue.push(std::move(receivedData));
-
+                for (auto& data : mInterface->readData()) {
+                    handleClientData(data);
+                }
             } catch (const std::exception& ex) {
                 logError("Exception: " + std::string(ex.what()));
             }
         }
     }
 
+    void handleClientData(PipeClientData& data) {
+        switch (data.kind) {
+            case PipeClientData::Kind::Connected: {
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                clients[data.client] = PipeEncoding::Json;
+                decoders[data.client].reset();
+                requestEncodings[data.client] = PipeEncoding::Json;
+                break;
+            }
+            case PipeClientData::Kind::Disconnected: {
+                {
+                    std::lock_guard<std::mutex> lock(clientsMutex);
+                    clients.erase(data.client);
+                    decoders.erase(data.client);
+                    requestEncodings.erase(data.client);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(topicsMutex);
+                    removeSubscriberLocked(data.client);
+                }
+                std::lock_guard<std::mutex> lock(listenerMutex);
+                if (disconnectListener) {
+                    disconnectListener(data.client);
+                }
+                break;
+            }
+            case PipeClientData::Kind::Data: {
+                // Each connection has its own decoder: one read may carry several
+                // frames, or only part of one
+                auto& decoder = decoders[data.client];
+                decoder.feed(data.bytes.data(), data.bytes.size());
+                try {
+                    while (auto frame = decoder.next()) {
+                        handleFrame(data.client, frame.value());
+                    }
+                } catch (const PipeProtocolError& ex) {
+                    logError("Protocol error from client " + std::to_string(data.client) + ": " + ex.what());
+                    decoder.reset();
+                    mInterface->closeClient(data.client);
+                }
+                break;
+            }
+        }
+    }
+
+    void handleFrame(PipeClientId clientId, const PipeFrame& frame) {
+        if (frame.header.type == PipeMessageType::Handshake) {
+            handleHandshake(clientId, frame);
+            return;
+        }
+
+        if (frame.header.type != PipeMessageType::Request) {
+            logError("Ignoring unexpected frame type " + std::to_string(static_cast<int>(frame.header.type)));
+            return;
+        }
+
+        try {
+            json request = decodePipePayload(frame.payload, requestEncodings[clientId]);
+            if (request.is_object() && (request.contains("subscribe") || request.contains("unsubscribe"))) {
+                handleSubscription(clientId, frame.header.requestId, request);
+                return;
+            }
+            receiveQueue.push(PipeRequest{clientId, frame.header.requestId, std::move(request)});
+        } catch (const json::exception& ex) {
+            logError("Malformed request " + std::to_string(frame.header.requestId) + ": " + ex.what());
+            json error;
+            error["error"] = "malformed request";
+            sendQueue.push(OutgoingMessage{PipeMessageType::Error, clientId, frame.header.requestId, makeSharedMessage(error)});
+        }
+    }
+
+    // {"encoding":"msgpack"|"cbor"|"json"}: requests that follow the handshake are
+    // decoded the new way at once, while the host switches its own output only when
+    // the send thread writes the reply, so nothing reaches the client in the new
+    // encoding ahead of it
+    void handleHandshake(PipeClientId clientId, const PipeFrame& frame) {
+        json request = json::parse(frame.payload, nullptr, false);
+        std::optional<PipeEncoding> encoding;
+        if (request.is_object() && request.contains("encoding") && request["encoding"].is_string()) {
+            encoding = pipeEncodingFromName(request["encoding"].get<std::string>());
+        }
+
+        if (!encoding.has_value()) {
+            logError("Unsupported handshake from client " + std::to_string(clientId) + ": " + frame.payload);
+            json error;
+            error["error"] = "unsupported encoding";
+            sendQueue.push(OutgoingMessage{PipeMessageType::Error, clientId, frame.header.requestId, makeSharedMessage(error)});
+            return;
+        }
+
+        requestEncodings[clientId] = encoding.value();
+
+        json reply;
+        reply["encoding"] = pipeEncodingName(encoding.value());
+        sendQueue.push(OutgoingMessage{PipeMessageType::Handshake, clientId, frame.header.requestId, makeSharedMessage(reply)});
+        logInfo("Client " + std::to_string(clientId) + " switched to " + pipeEncodingName(encoding.value()));
+    }
+
+    // {"subscribe":[topics],"queue":n,"policy":"dropOldest"|"dropNewest"|"disconnect",
+    // "delta":true} or {"unsubscribe":[topics]}, answered with the topics the client is subscribed
+    // to now. The reply goes through the client's subscriber queue ahead of the last
+    // value of each new topic, so the client sees it first and then current state.
+    void handleSubscription(PipeClientId clientId, uint32_t requestId, const json& request) {
+        bool subscribe = request.contains("subscribe");
+        auto topics = topicList(request[subscribe ? "subscribe" : "unsubscribe"]);
+        std::optional<DropPolicy> policy = DropPolicy::DropOldest;
+        if (request.contains("policy")) {
+            policy = request["policy"].is_string() ? dropPolicyFromName(request["policy"].get<std::string>()) : std::nullopt;
+        }
+        if (!topics.has_value() || !policy.has_value() || (request.contains("queue") && !request["queue"].is_number_unsigned())
+            || (request.contains("delta") && !request["delta"].is_boolean())) {
+            json error;
+            error["error"] = "malformed subscription";
+            sendQueue.push(OutgoingMessage{PipeMessageType::Error, clientId, requestId, makeSharedMessage(error)});
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(topicsMutex);
+            auto& subscriber = subscribers[clientId];
+            std::vector<QueuedMessagePtr> current;
+            for (const auto& topic : topics.value()) {
+                if (subscribe && subscriber.topics.insert(topic).second) {
+                    topicSubscribers[topic].insert(clientId);
+                    auto lastValue = lastValues.find(topic);
+                    if (lastValue != lastValues.end()) {
+                        current.push_back(lastValue->second);
+                    }
+                } else if (!subscribe && subscriber.topics.erase(topic) != 0) {
+                    unsubscribeLocked(clientId, topic);
+                    subscriber.sent.erase(topic);
+                }
+            }
+            if (subscribe) {
+                subscriber.policy = policy.value();
+                bool delta = request.value("delta", subscriber.delta);
+                if (delta != subscriber.delta) {
+                    // Whatever was sent meanwhile is no base for patches
+                    subscriber.sent.clear();
+                    subscriber.delta = delta;
+                }
+                if (request.contains("queue")) {
+                    subscriber.capacity = std::clamp<size_t>(request["queue"].get<size_t>(), 1, MAX_SUBSCRIBER_QUEUE);
+                }
+            }
+
+            json reply;
+            reply["subscribed"] = subscriber.topics;
+            subscriber.queue.push_back(std::make_shared<QueuedMessage>(
+                OutgoingMessage{PipeMessageType::Response, clientId, requestId, makeSharedMessage(reply)}));
+            for (const auto& message : current) {
+                enqueueLocked(subscriber, message);
+            }
+        }
+        wakeSendThread();
+    }
+
+    // A topic name or an array of them
+    static std::optional<std::vector<std::string>> topicList(const json& value) {
+        std::vector<std::string> topics;
+        for (const auto& topic : value.is_array() ? value : json::array({value})) {
+            if (!topic.is_string() || topic.get<std::string>().empty()) {
+                return std::nullopt;
+            }
+            topics.push_back(topic.get<std::string>());
+        }
+        return topics;
+    }
+
+    static std::optional<DropPolicy> dropPolicyFromName(const std::string& name) {
+        if (name == "dropOldest") {
+            return DropPolicy::DropOldest;
+        }
+        if (name == "dropNewest") {
+            return DropPolicy::DropNewest;
+        }
+        if (name == "disconnect") {
+            return DropPolicy::Disconnect;
+        }
+        return std::nullopt;
+    }
+
+    void enqueueLocked(Subscriber& subscriber, const QueuedMessagePtr& message) {
+        if (subscriber.overflowed) {
+            return;
+        }
+        auto& queue = subscriber.queue;
+        if (queue.size() >= subscriber.capacity) {
+            ++droppedEvents;
+            if (subscriber.policy == DropPolicy::DropNewest) {
+                return;
+            }
+            if (subscriber.policy == DropPolicy::Disconnect) {
+                subscriber.overflowed = true;
+                return;
+            }
+            // Subscription replies are never dropped, only events
+            auto oldest = std::find_if(queue.begin(), queue.end(), [](const QueuedMessagePtr& queued) {
+                return queued->message.type == PipeMessageType::Event;
+            });
+            if (oldest != queue.end()) {
+                queue.erase(oldest);
+            }
+        }
+        queue.push_back(message);
+    }
+
+    void unsubscribeLocked(PipeClientId clientId, const std::string& topic) {
+        auto topicClients = topicSubscribers.find(topic);
+        if (topicClients != topicSubscribers.end()) {
+            topicClients->second.erase(clientId);
+            if (topicClients->second.empty()) {
+                topicSubscribers.erase(topicClients);
+            }
+        }
+    }
+
+    void removeSubscriberLocked(PipeClientId clientId) {
+        auto subscriber = subscribers.find(clientId);
+        if (subscriber == subscribers.end()) {
+            return;
+        }
+        for (const auto& topic : subscriber->second.topics) {
+            unsubscribeLocked(clientId, topic);
+        }
+        subscribers.erase(subscriber);
+    }
+
+    // One marker in the send queue at a time, however fast events are published
+    void wakeSendThread() {
+        if (!subscriberWakeupPending.exchange(true)) {
+            sendQueue.push(OutgoingMessage{PipeMessageType::Event, SUBSCRIBERS, 0, nullptr});
+        }
+    }
+
+    // Send thread. Hands queued messages to the transport only while the client's
+    // unread backlog there stays under SUBSCRIBER_BACKLOG_LIMIT: whatever a slow
+    // client cannot take waits in its subscriber queue, where its drop policy
+    // applies, instead of piling up in the transport until it is disconnected.
+    void drainSubscribers() {
+        subscriberWakeupPending = false;
+
+        struct Write {
+            PipeClientId client;
+            PipeEncoding encoding;
+            QueuedMessagePtr message;
+        };
+        std::vector<Write> writes;
+        std::vector<PipeClientId> overflowed;
+        bool backlogged = false;
+        {
+            std::lock_guard<std::mutex> lock(topicsMutex);
+            for (auto subscriber = subscribers.begin(); subscriber != subscribers.end();) {
+                PipeClientId client = subscriber->first;
+                auto& state = subscriber->second;
+                ++subscriber;
+
+                if (state.overflowed) {
+                    overflowed.push_back(client);
+                    ++overflowDisconnects;
+                    removeSubscriberLocked(client);
+                    continue;
+                }
+
+                PipeEncoding encoding = clientEncoding(client);
+                size_t backlog = mInterface->outputBacklog(client);
+                while (!state.queue.empty() && backlog < SUBSCRIBER_BACKLOG_LIMIT) {
+                    auto message = state.delta ? deltaLocked(state, state.queue.front(), encoding) : state.queue.front();
+                    state.queue.pop_front();
+                    backlog += frameSize(message->message, encoding);
+                    writes.push_back(Write{client, encoding, std::move(message)});
+                }
+
+                if (!state.queue.empty()) {
+                    backlogged = true;
+                } else if (state.topics.empty()) {
+                    removeSubscriberLocked(client);
+                }
+            }
+        }
+        subscribersBacklogged = backlogged;
+
+        for (const auto& write : writes) {
+            writeMessage(write.client, write.message->message, write.encoding);
+        }
+        for (PipeClientId client : overflowed) {
+            logError("Subscriber " + std::to_string(client) + " fell behind, dropping it");
+            mInterface->closeClient(client);
+        }
+    }
+
+    // Send thread. What a delta subscriber gets for message: a patch against the
+    // previous event of the topic it was sent, if that encodes smaller, or the full
+    // event as a snapshot. It gets the full event at least every SNAPSHOT_INTERVAL
+    // events per topic, so a client that lost track resynchronizes.
+    QueuedMessagePtr deltaLocked(Subscriber& subscriber, const QueuedMessagePtr& message, PipeEncoding encoding) {
+        if (message->topic.empty()) {
+            return message;
+        }
+
+        auto& sent = subscriber.sent[message->topic];
+        QueuedMessagePtr base = std::move(sent.base);
+        sent.base = message;
+        if (!base || sent.patchesSinceSnapshot >= SNAPSHOT_INTERVAL) {
+            sent.patchesSinceSnapshot = 0;
+            return message;
+        }
+
+        const auto& patch = message->patchFrom(*base);
+        if (frameSize(patch->message, encoding) >= frameSize(message->message, encoding)) {
+            sent.patchesSinceSnapshot = 0;
+            return message;
+        }
+        ++sent.patchesSinceSnapshot;
+        ++patchesSent;
+        return patch;
+    }
+
+    // Send thread. The payload buffer is the body's own, the same for every request
+    // and client it goes to; only the header is written per frame.
+    void writeMessage(PipeClientId client, const OutgoingMessage& message, PipeEncoding encoding) {
+        PipeBuffer payload = message.body->payload(encoding);
+        auto header = std::make_shared<const std::string>(
+            encodePipeFrameHeader(message.type, message.requestId, payload->size()));
+        mInterface->writeData(client, {std::move(header), std::move(payload)});
+    }
+
+    static size_t frameSize(const OutgoingMessage& message, PipeEncoding encoding) {
+        return PIPE_FRAME_HEADER_SIZE + message.body->payload(encoding)->size();
+    }
+
+    // Send thread, after writing a handshake reply
+    void setClientEncoding(PipeClientId clientId, const json& reply) {
+        auto encoding = pipeEncodingFromName(reply.value("encoding", ""));
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        auto client = clients.find(clientId);
+        if (client != clients.end() && encoding.has_value()) {
+            client->second = encoding.value();
+        }
+    }
+
+    PipeEncoding clientEncoding(PipeClientId clientId) {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        auto client = clients.find(clientId);
+        return client != clients.end() ? client->second : PipeEncoding::Json;
+    }
+
+    std::vector<std::pair<PipeClientId, PipeEncoding>> connectedClients() {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        return std::vector<std::pair<PipeClientId, PipeEncoding>>(clients.begin(), clients.end());
+    }
+
 private:
     static constexpr std::chrono::milliseconds REQUEST_QUEUE_READ_TIMEOUT_MILLISECONDS = std::chrono::milliseconds(1000);
     std::atomic_bool stopRequested;
     std::unique_ptr<PipeServerInterface> mInterface;
     std::thread sendThread;
     std::thread receiveThread;
-    ConcurrentQueue<json> sendQueue;
-    ConcurrentQueue<json> receiveQueue;    
+    std::map<PipeClientId, PipeFrameDecoder> decoders;   // Receive thread only
+    std::map<PipeClientId, PipeEncoding> requestEncodings;   // Receive thread only
+    std::mutex listenerMutex;
+    std::function<void(PipeClientId)> disconnectListener;
+    std::mutex clientsMutex;
+    std::map<PipeClientId, PipeEncoding> clients;   // Connected clients and the encoding of their responses
+    ConcurrentQueue<OutgoingMessage> sendQueue;
+    ConcurrentQueue<PipeRequest> receiveQueue;
+
+    static constexpr size_t DEFAULT_SUBSCRIBER_QUEUE = 64;
+    static constexpr size_t MAX_SUBSCRIBER_QUEUE = 1024;
+    // Unread bytes a subscriber may have in the transport before events wait in its queue
+    static constexpr size_t SUBSCRIBER_BACKLOG_LIMIT = 256 * 1024;
+    static constexpr std::chrono::milliseconds SUBSCRIBER_RETRY_INTERVAL = std::chrono::milliseconds(10);
+    std::mutex topicsMutex;   // Taken before clientsMutex and the transport's locks
+    std::map<PipeClientId, Subscriber> subscribers;
+    std::map<std::string, std::set<PipeClientId>> topicSubscribers;
+    std::map<std::string, QueuedMessagePtr> lastValues;   // Latest event of each topic, for new subscribers
+    // Delta subscribers get a full event at least this often per topic
+    static constexpr unsigned SNAPSHOT_INTERVAL = 32;
+    uint64_t droppedEvents{0};
+    uint64_t patchesSent{0};
+    std::atomic<uint64_t> publishedEvents{0};
+    uint64_t overflowDisconnects{0};
+    std::atomic_bool subscriberWakeupPending{false};
+    bool subscribersBacklogged{false};   // Send thread only
 };
 
-PipeServer::PipeServer(const std::string& pipeName): mImpl(std::make_unique<PipeServerImpl>(pipeName)) {
+PipeServer::PipeServer(const std::string& pipeName, const PipeServerOptions& options): mImpl(std::make_unique<PipeServerImpl>(pipeName, options)) {
 
 }
 
@@ -223,10 +926,34 @@ void PipeServer::stop() {
     mImpl->stop();
 }
 
-void PipeServer::sendResponse(const nlohmann::json& request) {
-    mImpl->sendResponse(request);
+void PipeServer::sendResponse(PipeClientId clientId, uint32_t requestId, const nlohmann::json& response) {
+    mImpl->sendResponse(clientId, requestId, makeSharedMessage(response));
 }
-    
-std::optional<nlohmann::json> PipeServer::readRequest(std::chrono::milliseconds timeout) {
+
+void PipeServer::sendResponse(PipeClientId clientId, uint32_t requestId, SharedMessagePtr response) {
+    mImpl->sendResponse(clientId, requestId, std::move(response));
+}
+
+void PipeServer::sendEvent(const nlohmann::json& event) {
+    mImpl->sendEvent(event);
+}
+
+void PipeServer::publish(const std::string& topic, const nlohmann::json& event) {
+    mImpl->publish(topic, event);
+}
+
+bool PipeServer::hasSubscribers(const std::string& topic) {
+    return mImpl->hasSubscribers(topic);
+}
+
+void PipeServer::setDisconnectListener(std::function<void(PipeClientId)> listener) {
+    mImpl->setDisconnectListener(std::move(listener));
+}
+
+nlohmann::json PipeServer::topicStatistics() {
+    return mImpl->topicStatistics();
+}
+
+std::optional<PipeRequest> PipeServer::readRequest(std::chrono::milliseconds timeout) {
     return mImpl->readRequest(timeout);
 }
\ No newline at end of file
@@ -3,19 +3,74 @@
 
 #include <memory>
 #include <optional>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <functional>
 
 #include "json.hpp"
+#include "PipeServerInterface.h"
+#include "SharedMessage.hpp"
 
 class PipeServerImpl;
 
+// How clients reach the server
+enum class PipeTransport {
+    Fifo,         // One named pipe shared by a single logical client
+    UnixSocket,   // Unix domain socket, any number of concurrent clients
+    DualFifo,     // Handshake FIFO plus a private request/response FIFO pair per client
+    SharedMemory, // memfd ring pair per co-located client, handed over a Unix socket
+    IoUring,      // UnixSocket protocol served from one io_uring (epoll if unavailable)
+};
+
+struct PipeServerOptions {
+    PipeTransport transport = PipeTransport::UnixSocket;
+    // Kernel buffer requested with F_SETPIPE_SZ for the FIFO transports, so bursts do
+    // not block the writer (0 keeps the kernel default of 64 KB)
+    size_t pipeBufferSize = 1024 * 1024;
+    // Size of each direction's ring for the shared memory transport
+    size_t ringCapacity = 1024 * 1024;
+};
+
+// A decoded request frame from a pipe client
+struct PipeRequest {
+    PipeClientId clientId;
+    uint32_t requestId;
+    nlohmann::json body;
+};
+
 class PipeServer {
 public:
-    PipeServer(const std::string& pipeName);
+    PipeServer(const std::string& pipeName, const PipeServerOptions& options = PipeServerOptions());
     ~PipeServer();
     
-    void sendResponse(const nlohmann::json& request);
+    // Answer the request with the given id, on the connection it came from
+    void sendResponse(PipeClientId clientId, uint32_t requestId, const nlohmann::json& response);
+
+    // Same for a response that answers other requests too: its payload is serialized
+    // once per encoding and written as is, behind each request's own frame header
+    void sendResponse(PipeClientId clientId, uint32_t requestId, SharedMessagePtr response);
+
+    // Push an unsolicited message to every connected client
+    void sendEvent(const nlohmann::json& event);
+
+    // Push event as {"topic","data"} to the clients subscribed to topic, and keep it
+    // as the topic's last value that clients subscribing later get right away. It is
+    // serialized once per payload encoding in use, however many clients subscribed.
+    // Clients subscribe with a {"subscribe":[topics]} request, see README.md.
+    void publish(const std::string& topic, const nlohmann::json& event);
+
+    // Lets producers skip building events nobody would receive
+    bool hasSubscribers(const std::string& topic);
+
+    // Called on the receive thread once a client is gone, whether it hung up or was
+    // dropped by the server; must not block
+    void setDisconnectListener(std::function<void(PipeClientId)> listener);
+
+    // {"subscribers":{topic:clients},"queued","dropped","disconnected"}
+    nlohmann::json topicStatistics();
 
-    std::optional<nlohmann::json> readRequest(std::chrono::milliseconds timeout = READ_REQUEST_TIMEOUT_MILLISECONDS);
+    std::optional<PipeRequest> readRequest(std::chrono::milliseconds timeout = READ_REQUEST_TIMEOUT_MILLISECONDS);
 
     void start();
     void stop();
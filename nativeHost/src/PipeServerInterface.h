@@ -0,0 +1,54 @@
+#ifndef PIPE_SERVER_INTERFACE_H
+#define PIPE_SERVER_INTERFACE_H
+
+#include <string>
+#include <vector>
+#include <initializer_list>
+#include <cstddef>
+#include <cstdint>
+
+#include "PipeOutputQueue.hpp"
+
+// Identifies one connected client of a transport. 0 is never a valid client.
+using PipeClientId = uint64_t;
+
+// Something that happened on a transport: a client connected, sent bytes (which may
+// hold any number of partial or complete frames), or went away
+struct PipeClientData {
+    enum class Kind { Connected, Data, Disconnected };
+
+    Kind kind;
+    PipeClientId client;
+    std::string bytes;
+};
+
+// Byte transport underneath PipeServer. Framing and message handling live in
+// PipeServerImpl; transports only move bytes for their clients.
+class PipeServerInterface {
+public:
+    virtual ~PipeServerInterface() {};
+
+    virtual void start() = 0;
+    virtual void stop() = 0;
+
+    // Wait for client activity. May return an empty vector on timeout or wakeup().
+    virtual std::vector<PipeClientData> readData() = 0;
+
+    // Queue buffers for one client, in order and all or none. The transport keeps
+    // references to them, not copies. Unknown or disconnected clients are ignored.
+    virtual void writeData(PipeClientId client, std::initializer_list<PipeBuffer> buffers) = 0;
+
+    // Drop a client, e.g. after a protocol error. Transports that track clients report
+    // it as Disconnected from the next readData(), as if the client had hung up.
+    virtual void closeClient(PipeClientId client) = 0;
+
+    // Bytes written for client that the transport still holds because the client
+    // has not read them yet, so optional output can be held back for slow clients.
+    // 0 if the transport does not know.
+    virtual size_t outputBacklog(PipeClientId client) { (void)client; return 0; }
+
+    // Make a blocked readData() return promptly
+    virtual void wakeup() {}
+};
+
+#endif  // PIPE_SERVER_INTERFACE_H
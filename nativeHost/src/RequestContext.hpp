@@ -0,0 +1,78 @@
+#ifndef REQUEST_CONTEXT_H
+#define REQUEST_CONTEXT_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <algorithm>
+
+// What a pipe client attached to a request besides its body: an optional deadline,
+// and whether it has cancelled the request since. Shared by the dispatcher, the
+// handler working on the request and whoever cancels it, so it is thread-safe.
+class RequestContext {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestContext(std::optional<Clock::time_point> deadline = std::nullopt) : deadline_(deadline) {}
+
+    std::optional<Clock::time_point> deadline() const { return deadline_; }
+
+    bool expired(Clock::time_point now = Clock::now()) const {
+        return deadline_.has_value() && deadline_.value() <= now;
+    }
+
+    // The smaller of limit and the time left before the deadline, never negative
+    std::chrono::milliseconds remaining(std::chrono::milliseconds limit, Clock::time_point now = Clock::now()) const {
+        if (!deadline_.has_value()) {
+            return limit;
+        }
+        if (deadline_.value() <= now) {
+            return std::chrono::milliseconds(0);
+        }
+        return std::min(limit, std::chrono::ceil<std::chrono::milliseconds>(deadline_.value() - now));
+    }
+
+    bool cancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+    // Nobody is waiting for the answer any more
+    bool abandoned() const { return cancelled() || expired(); }
+
+    // Marks the request cancelled and runs the cancel hook; only the first call has
+    // any effect
+    void cancel() {
+        std::function<void()> hook;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (cancelled_.exchange(true, std::memory_order_acq_rel)) {
+                return;
+            }
+            hook = std::move(onCancel_);
+        }
+        if (hook) {
+            hook();
+        }
+    }
+
+    // How cancel() stops the work in flight, e.g. abandons the round trip to the
+    // extension. Runs right away if the request is already cancelled.
+    void setCancelHook(std::function<void()> hook) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!cancelled_.load(std::memory_order_acquire)) {
+                onCancel_ = std::move(hook);
+                return;
+            }
+        }
+        hook();
+    }
+
+private:
+    const std::optional<Clock::time_point> deadline_;
+    std::atomic_bool cancelled_{false};
+    std::mutex mutex_;
+    std::function<void()> onCancel_;
+};
+
+#endif  // REQUEST_CONTEXT_H
@@ -0,0 +1,62 @@
+#include "ResponseCache.h"
+
+ResponseCache::ResponseCache(TimerWheel& timers) : timers(timers) {}
+
+void ResponseCache::setTtl(const std::string& action, std::chrono::milliseconds ttl) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ttls[action] = ttl;
+}
+
+SharedMessagePtr ResponseCache::get(const std::string& action) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = entries.find(action);
+    // The eviction timer may not have run yet
+    if (entry == entries.end() || entry->second.expiresAt <= TimerWheel::Clock::now()) {
+        ++misses;
+        return nullptr;
+    }
+    ++hits;
+    return entry->second.response;
+}
+
+uint64_t ResponseCache::generation() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return currentGeneration;
+}
+
+void ResponseCache::put(const std::string& action, const SharedMessagePtr& response, uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto ttl = ttls.find(action);
+    if (generation != currentGeneration || ttl == ttls.end() || ttl->second.count() <= 0) {
+        return;
+    }
+
+    auto expiresAt = TimerWheel::Clock::now() + ttl->second;
+    auto existing = entries.find(action);
+    if (existing != entries.end()) {
+        timers.cancel(existing->second.timer);
+    }
+    auto timer = timers.schedule(expiresAt, [this, action, expiresAt] {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = entries.find(action);
+        if (entry != entries.end() && entry->second.expiresAt == expiresAt) {
+            entries.erase(entry);
+        }
+    });
+    entries[action] = Entry{response, expiresAt, timer};
+}
+
+void ResponseCache::invalidateAll() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++currentGeneration;
+    ++invalidations;
+    for (const auto& entry : entries) {
+        timers.cancel(entry.second.timer);
+    }
+    entries.clear();
+}
+
+ResponseCache::Statistics ResponseCache::statistics() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return Statistics{hits.load(), misses.load(), invalidations.load(), entries.size()};
+}
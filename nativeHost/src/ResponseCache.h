@@ -0,0 +1,63 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "SharedMessage.hpp"
+#include "TimerWheel.h"
+
+// Responses of actions whose answer rarely changes, keyed by action. An entry lives
+// for its action's TTL or until invalidateAll(), e.g. because the extension
+// reported that the active tab changed.
+class ResponseCache {
+public:
+    // Expired entries are evicted by timers on timers
+    explicit ResponseCache(TimerWheel& timers);
+
+    // Actions without a TTL (or with a TTL of zero) are never cached
+    void setTtl(const std::string& action, std::chrono::milliseconds ttl);
+
+    // Counts a hit or a miss; null on a miss. Every hit shares the one response,
+    // serialized once.
+    SharedMessagePtr get(const std::string& action);
+
+    // Take this before fetching a response and hand it to put(): a response
+    // fetched across an invalidation is dropped rather than cached
+    uint64_t generation();
+
+    void put(const std::string& action, const SharedMessagePtr& response, uint64_t generation);
+
+    void invalidateAll();
+
+    struct Statistics {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t invalidations;
+        size_t entries;
+    };
+
+    Statistics statistics();
+
+private:
+    struct Entry {
+        SharedMessagePtr response;
+        TimerWheel::Clock::time_point expiresAt;
+        TimerWheel::TimerId timer;
+    };
+
+    TimerWheel& timers;
+    std::mutex mutex;
+    std::map<std::string, std::chrono::milliseconds> ttls;
+    std::map<std::string, Entry> entries;
+    uint64_t currentGeneration{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> invalidations{0};
+};
+
+#endif  // RESPONSE_CACHE_H
@@ -0,0 +1,56 @@
+#ifndef RTT_ESTIMATOR_H
+#define RTT_ESTIMATOR_H
+
+#include <array>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+
+// Running round-trip time distribution over the most recent samples, used to derive
+// request timeouts from what the extension actually does rather than fixed constants
+class RttEstimator {
+public:
+    struct Estimate {
+        size_t samples{0};
+        std::chrono::microseconds p50{0};
+        std::chrono::microseconds p99{0};
+    };
+
+    void addSample(std::chrono::microseconds rtt) {
+        samples_[next_] = rtt;
+        next_ = (next_ + 1) % WINDOW;
+        if (count_ < WINDOW) {
+            ++count_;
+        }
+    }
+
+    Estimate estimate() const {
+        Estimate result;
+        result.samples = count_;
+        if (count_ == 0) {
+            return result;
+        }
+
+        std::vector<std::chrono::microseconds> sorted(samples_.begin(), samples_.begin() + count_);
+        result.p50 = percentile(sorted, 50);
+        result.p99 = percentile(sorted, 99);
+        return result;
+    }
+
+private:
+    static constexpr size_t WINDOW = 256;
+
+    static std::chrono::microseconds percentile(std::vector<std::chrono::microseconds>& values, size_t percent) {
+        size_t rank = (values.size() * percent + 99) / 100;
+        auto nth = values.begin() + static_cast<std::ptrdiff_t>(std::max<size_t>(rank, 1) - 1);
+        std::nth_element(values.begin(), nth, values.end());
+        return *nth;
+    }
+
+    std::array<std::chrono::microseconds, WINDOW> samples_{};
+    size_t next_{0};
+    size_t count_{0};
+};
+
+#endif  // RTT_ESTIMATOR_H
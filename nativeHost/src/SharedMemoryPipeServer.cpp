@@ -0,0 +1,437 @@
+#include "SharedMemoryPipeServer.h"
+#include "Logger.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    inline void logError(const std::string& errorMessage) {
+        LOG_TAGGED_ERROR(Logger::LogTag::PIPE_SERVER, errorMessage);
+    }
+
+    inline void logInfo(const std::string& infoMessage) {
+        LOG_TAGGED_INFO(Logger::LogTag::PIPE_SERVER, infoMessage);
+    }
+
+    // epoll tokens: a client's doorbell uses the client id, its socket the client id
+    // with SOCKET_TOKEN_BIT set
+    constexpr uint64_t LISTEN_TOKEN = 0;
+    constexpr uint64_t WAKEUP_TOKEN = UINT64_MAX;
+    constexpr uint64_t SOCKET_TOKEN_BIT = uint64_t(1) << 62;
+
+    constexpr int EPOLL_WAIT_TIMEOUT_MILLISECONDS = 1000;
+    constexpr int MAX_EPOLL_EVENTS = 64;
+    // A client that lets this much output pile up beyond its ring is dropped
+    constexpr size_t MAX_PENDING_OUTPUT = 8 * 1024 * 1024;
+
+    std::string errnoString() {
+        return std::string(strerror(errno));
+    }
+
+    size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = 4096;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    void ringDoorbell(int eventFd) {
+        eventfd_write(eventFd, 1);
+    }
+}
+
+SharedMemoryPipeServer::SharedMemoryPipeServer(const std::string& socketPath, size_t ringCapacity)
+    : socketPath(socketPath), ringCapacity(roundUpToPowerOfTwo(ringCapacity)) {}
+
+SharedMemoryPipeServer::~SharedMemoryPipeServer() {
+    try {
+        stop();
+    } catch (const std::exception& ex) {
+        logError("Exception: " + std::string(ex.what()));
+    }
+}
+
+void SharedMemoryPipeServer::start() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: '" + socketPath + "'");
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    if (unlink(socketPath.c_str()) == -1 && errno != ENOENT) {
+        throw std::runtime_error("Error unlinking existing socket '" + socketPath + "': " + errnoString());
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd == -1) {
+        throw std::runtime_error("Error creating socket: " + errnoString());
+    }
+
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        throw std::runtime_error("Error binding socket '" + socketPath + "': " + errnoString());
+    }
+    chmod(socketPath.c_str(), 0666);
+
+    if (listen(listenFd, SOMAXCONN) == -1) {
+        throw std::runtime_error("Error listening on socket '" + socketPath + "': " + errnoString());
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || wakeupFd == -1) {
+        throw std::runtime_error("Error creating epoll/eventfd: " + errnoString());
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = LISTEN_TOKEN;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    event.data.u64 = WAKEUP_TOKEN;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event);
+
+    logInfo("Shared memory transport listening on '" + socketPath + "'");
+}
+
+void SharedMemoryPipeServer::stop() {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    while (!connections.empty()) {
+        closeClientLocked(connections.begin()->first);
+    }
+    closedClients.clear();
+
+    for (int* fd : {&listenFd, &epollFd, &wakeupFd}) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+
+    if (unlink(socketPath.c_str()) == -1 && errno != ENOENT) {
+        throw std::runtime_error("Error unlinking socket '" + socketPath + "': " + errnoString());
+    }
+}
+
+std::vector<PipeClientData> SharedMemoryPipeServer::readData() {
+    std::vector<PipeClientData> result;
+    if (epollFd == -1) {
+        return result;
+    }
+
+    // While there is traffic we keep polling the rings and never touch the doorbells
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        collect(result);
+        if (!result.empty()) {
+            return result;
+        }
+        if (!prepareSleep()) {
+            for (auto& [client, connection] : connections) {
+                connection.requests.cancelConsumerSleep();
+            }
+            collect(result);
+            return result;
+        }
+    }
+
+    epoll_event events[MAX_EPOLL_EVENTS];
+    int count = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, EPOLL_WAIT_TIMEOUT_MILLISECONDS);
+    if (count == -1 && errno != EINTR) {
+        throw std::runtime_error("Error waiting on socket '" + socketPath + "': " + errnoString());
+    }
+
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    for (int i = 0; i < count; ++i) {
+        uint64_t token = events[i].data.u64;
+
+        if (token == WAKEUP_TOKEN) {
+            eventfd_t value;
+            eventfd_read(wakeupFd, &value);
+        } else if (token == LISTEN_TOKEN) {
+            acceptClients(result);
+        } else if (token & SOCKET_TOKEN_BIT) {
+            // The socket carries no traffic after the handshake: readable means gone
+            PipeClientId client = token & ~SOCKET_TOKEN_BIT;
+            if (connections.count(client) != 0) {
+                std::string last;
+                try {
+                    connections.at(client).requests.read(last);
+                } catch (const SharedRingCorruptedError& ex) {
+                    logError("Client " + std::to_string(client) + ": " + ex.what());
+                }
+                if (!last.empty()) {
+                    result.push_back(PipeClientData{PipeClientData::Kind::Data, client, std::move(last)});
+                }
+                closeClientLocked(client);
+                result.push_back(PipeClientData{PipeClientData::Kind::Disconnected, client, std::string()});
+            }
+        } else {
+            auto connection = connections.find(token);
+            if (connection != connections.end()) {
+                eventfd_t value;
+                eventfd_read(connection->second.serverDoorbell, &value);
+            }
+        }
+    }
+
+    for (auto& [client, connection] : connections) {
+        connection.requests.cancelConsumerSleep();
+    }
+    collect(result);
+    return result;
+}
+
+void SharedMemoryPipeServer::writeData(PipeClientId client, std::initializer_list<PipeBuffer> buffers) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    auto connection = connections.find(client);
+    if (connection == connections.end()) {
+        return;
+    }
+
+    auto& pending = connection->second.pendingOutput;
+    if (pending.size() > MAX_PENDING_OUTPUT || connection->second.corrupted) {
+        return;   // Already marked for dropping
+    }
+
+    for (const auto& buffer : buffers) {
+        pending.push(buffer);
+    }
+    flushClient(connection->second);
+
+    if (pending.size() > MAX_PENDING_OUTPUT || connection->second.corrupted) {
+        // Let the receive loop close it and report the disconnect
+        wakeup();
+    } else if (!pending.empty() && !connection->second.responses.prepareProducerSleep()) {
+        flushClient(connection->second);
+    }
+}
+
+void SharedMemoryPipeServer::closeClient(PipeClientId client) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    if (connections.count(client) == 0) {
+        return;
+    }
+    closeClientLocked(client);
+    closedClients.push_back(client);
+    wakeup();
+}
+
+size_t SharedMemoryPipeServer::outputBacklog(PipeClientId client) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    auto connection = connections.find(client);
+    return connection != connections.end() ? connection->second.pendingOutput.size() : 0;
+}
+
+void SharedMemoryPipeServer::wakeup() {
+    if (wakeupFd != -1) {
+        eventfd_write(wakeupFd, 1);
+    }
+}
+
+void SharedMemoryPipeServer::acceptClients(std::vector<PipeClientData>& events) {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                logError("Error accepting client: " + errnoString());
+            }
+            return;
+        }
+
+        try {
+            openClient(fd, events);
+        } catch (const std::exception& ex) {
+            logError("Exception: " + std::string(ex.what()));
+            close(fd);
+        }
+    }
+}
+
+void SharedMemoryPipeServer::openClient(int socketFd, std::vector<PipeClientData>& events) {
+    Connection connection;
+    connection.mappingSize = 2 * SharedRing::footprint(ringCapacity);
+    connection.memoryFd = memfd_create("native-host-pipe", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    connection.serverDoorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    connection.clientDoorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (connection.memoryFd == -1 || connection.serverDoorbell == -1 || connection.clientDoorbell == -1
+        || ftruncate(connection.memoryFd, static_cast<off_t>(connection.mappingSize)) == -1
+        // The client gets the descriptor writable: it must not be able to shrink the
+        // memory under our mapping, which would turn ring accesses into SIGBUS
+        || fcntl(connection.memoryFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+        std::string error = errnoString();
+        releaseConnection(connection);
+        throw std::runtime_error("Error creating shared memory: " + error);
+    }
+
+    void* mapping = mmap(nullptr, connection.mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, connection.memoryFd, 0);
+    if (mapping == MAP_FAILED) {
+        std::string error = errnoString();
+        releaseConnection(connection);
+        throw std::runtime_error("Error mapping shared memory: " + error);
+    }
+    connection.mapping = mapping;
+    connection.requests = SharedRing(mapping, ringCapacity);
+    connection.responses = SharedRing(static_cast<char*>(mapping) + SharedRing::footprint(ringCapacity), ringCapacity);
+    connection.requests.initialise();
+    connection.responses.initialise();
+
+    // Hand the memory and both doorbells to the client
+    SharedMemoryHandshake handshake{SharedMemoryHandshake::MAGIC, SharedMemoryHandshake::VERSION, ringCapacity};
+    iovec iov{&handshake, sizeof(handshake)};
+    int fds[3] = {connection.memoryFd, connection.serverDoorbell, connection.clientDoorbell};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    if (sendmsg(socketFd, &message, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(handshake))) {
+        std::string error = errnoString();
+        releaseConnection(connection);
+        throw std::runtime_error("Error sending shared memory handshake: " + error);
+    }
+
+    PipeClientId client = nextClientId++;
+    connection.socketFd = socketFd;
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = client;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, connection.serverDoorbell, &event);
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.u64 = client | SOCKET_TOKEN_BIT;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, socketFd, &event);
+
+    connections.emplace(client, std::move(connection));
+    events.push_back(PipeClientData{PipeClientData::Kind::Connected, client, std::string()});
+}
+
+// Drain every request ring and retry pending output; no syscalls unless a
+// sleeping peer has to be woken
+void SharedMemoryPipeServer::collect(std::vector<PipeClientData>& events) {
+    for (PipeClientId client : closedClients) {
+        events.push_back(PipeClientData{PipeClientData::Kind::Disconnected, client, std::string()});
+    }
+    closedClients.clear();
+    for (auto connection = connections.begin(); connection != connections.end();) {
+        PipeClientId client = connection->first;
+        auto& state = connection->second;
+        ++connection;
+
+        if (state.pendingOutput.size() > MAX_PENDING_OUTPUT) {
+            logError("Client " + std::to_string(client) + " is not reading, dropping it");
+            closeClientLocked(client);
+            events.push_back(PipeClientData{PipeClientData::Kind::Disconnected, client, std::string()});
+            continue;
+        }
+
+        std::string bytes;
+        try {
+            if (!state.corrupted && state.requests.read(bytes) > 0) {
+                if (state.requests.producerNeedsWakeup()) {
+                    ringDoorbell(state.clientDoorbell);
+                }
+                events.push_back(PipeClientData{PipeClientData::Kind::Data, client, std::move(bytes)});
+            }
+        } catch (const SharedRingCorruptedError& ex) {
+            logError("Client " + std::to_string(client) + ": " + ex.what());
+            state.corrupted = true;
+        }
+
+        if (!state.corrupted && !state.pendingOutput.empty()) {
+            flushClient(state);
+        }
+
+        if (state.corrupted) {
+            logError("Client " + std::to_string(client) + " corrupted its shared memory, dropping it");
+            closeClientLocked(client);
+            events.push_back(PipeClientData{PipeClientData::Kind::Disconnected, client, std::string()});
+        }
+    }
+}
+
+// Arm the doorbells of every ring we wait on. Returns false if work raced in.
+bool SharedMemoryPipeServer::prepareSleep() {
+    bool sleep = true;
+    for (auto& [client, connection] : connections) {
+        if (!connection.requests.prepareConsumerSleep()) {
+            sleep = false;
+        }
+        if (!connection.pendingOutput.empty() && !connection.responses.prepareProducerSleep()) {
+            sleep = false;
+        }
+    }
+    return sleep;
+}
+
+void SharedMemoryPipeServer::flushClient(Connection& connection) {
+    // The ring is the client's memory, so the bytes are copied here, straight from
+    // the queued buffers
+    auto& pending = connection.pendingOutput;
+    size_t written = 0;
+    try {
+        while (!pending.empty()) {
+            auto bytes = pending.front();
+            size_t copied = connection.responses.write(bytes.data(), bytes.size());
+            pending.consume(copied);
+            written += copied;
+            if (copied < bytes.size()) {
+                break;
+            }
+        }
+    } catch (const SharedRingCorruptedError& ex) {
+        logError(ex.what());
+        connection.corrupted = true;
+        pending.clear();
+        return;
+    }
+    if (written == 0) {
+        return;
+    }
+
+    if (connection.responses.consumerNeedsWakeup()) {
+        ringDoorbell(connection.clientDoorbell);
+    }
+}
+
+void SharedMemoryPipeServer::closeClientLocked(PipeClientId client) {
+    auto connection = connections.find(client);
+    if (connection == connections.end()) {
+        return;
+    }
+    releaseConnection(connection->second);
+    connections.erase(connection);
+}
+
+void SharedMemoryPipeServer::releaseConnection(Connection& connection) {
+    if (connection.mapping != nullptr) {
+        munmap(connection.mapping, connection.mappingSize);
+        connection.mapping = nullptr;
+    }
+    for (int* fd : {&connection.socketFd, &connection.memoryFd, &connection.serverDoorbell, &connection.clientDoorbell}) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
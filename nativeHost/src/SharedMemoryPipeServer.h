@@ -0,0 +1,82 @@
+#ifndef SHARED_MEMORY_PIPE_SERVER_H
+#define SHARED_MEMORY_PIPE_SERVER_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+#include "PipeServerInterface.h"
+#include "SharedRing.hpp"
+
+// Sent by the server right after accepting a connection, together with three file
+// descriptors (SCM_RIGHTS, in this order):
+//   memfd           requests ring followed by the responses ring, each
+//                   SharedRing::footprint(ringCapacity) bytes
+//   serverDoorbell  eventfd the client writes to wake the server
+//   clientDoorbell  eventfd the server writes to wake the client
+struct SharedMemoryHandshake {
+    static constexpr uint32_t MAGIC = 0x4d53484e;   // "NHSM"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ringCapacity;
+};
+
+// PipeServerInterface for co-located clients. The Unix socket at `pipeName` is only
+// used to hand over the shared memory at connect time and to notice the client
+// going away; frames travel through a pair of SPSC rings in a memfd, and eventfd
+// doorbells are rung only when the other side is actually asleep.
+class SharedMemoryPipeServer : public PipeServerInterface {
+public:
+    // ringCapacity is rounded up to a power of two
+    SharedMemoryPipeServer(const std::string& socketPath, size_t ringCapacity);
+    ~SharedMemoryPipeServer() override;
+
+    void start() override;
+    void stop() override;
+    std::vector<PipeClientData> readData() override;
+    void writeData(PipeClientId client, std::initializer_list<PipeBuffer> buffers) override;
+    void closeClient(PipeClientId client) override;
+    size_t outputBacklog(PipeClientId client) override;
+    void wakeup() override;
+
+private:
+    struct Connection {
+        int socketFd{-1};
+        int memoryFd{-1};
+        int serverDoorbell{-1};
+        int clientDoorbell{-1};
+        void* mapping{nullptr};
+        size_t mappingSize{0};
+        SharedRing requests;        // Client to server
+        SharedRing responses;       // Server to client
+        PipeOutputQueue pendingOutput;  // Bytes that did not fit into the responses ring
+        bool corrupted{false};      // The client broke a ring's indices, collect() drops it
+    };
+
+    void acceptClients(std::vector<PipeClientData>& events);
+    void openClient(int socketFd, std::vector<PipeClientData>& events);
+    void collect(std::vector<PipeClientData>& events);
+    bool prepareSleep();
+    void flushClient(Connection& connection);
+    void closeClientLocked(PipeClientId client);
+    static void releaseConnection(Connection& connection);
+
+    SharedMemoryPipeServer(const SharedMemoryPipeServer&) = delete;
+    SharedMemoryPipeServer& operator=(const SharedMemoryPipeServer&) = delete;
+
+    std::string socketPath;
+    size_t ringCapacity;
+    int listenFd{-1};
+    int epollFd{-1};
+    int wakeupFd{-1};
+    PipeClientId nextClientId{1};
+    std::mutex connectionsMutex;
+    std::map<PipeClientId, Connection> connections;
+    // Dropped by closeClient, reported as disconnected by the next readData
+    std::vector<PipeClientId> closedClients;
+};
+
+#endif  // SHARED_MEMORY_PIPE_SERVER_H
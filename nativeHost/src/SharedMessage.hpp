@@ -0,0 +1,45 @@
+#ifndef SHARED_MESSAGE_H
+#define SHARED_MESSAGE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "json.hpp"
+#include "PipeEncoding.hpp"
+#include "PipeOutputQueue.hpp"
+
+// A message body built once and then only read: requests answered by one execution
+// all hold the same SharedMessage, and its payload is serialized at most once per
+// encoding however many of them it is written to. Whoever needs to know whether two
+// answers are the same compares the pointers.
+class SharedMessage {
+public:
+    explicit SharedMessage(nlohmann::json value) : value_(std::move(value)) {}
+
+    const nlohmann::json& value() const { return value_; }
+
+    // The body encoded for the wire, without a frame header, serialized on first use
+    PipeBuffer payload(PipeEncoding encoding) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = payloads_.find(encoding);
+        if (found == payloads_.end()) {
+            found = payloads_.emplace(encoding, std::make_shared<const std::string>(encodePipePayload(value_, encoding))).first;
+        }
+        return found->second;
+    }
+
+private:
+    const nlohmann::json value_;
+    mutable std::mutex mutex_;
+    mutable std::map<PipeEncoding, PipeBuffer> payloads_;
+};
+
+using SharedMessagePtr = std::shared_ptr<const SharedMessage>;
+
+inline SharedMessagePtr makeSharedMessage(nlohmann::json value) {
+    return std::make_shared<const SharedMessage>(std::move(value));
+}
+
+#endif  // SHARED_MESSAGE_H
@@ -0,0 +1,163 @@
+#ifndef SHARED_RING_H
+#define SHARED_RING_H
+
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+// Control block of a single-producer/single-consumer byte ring living in memory
+// shared between two processes. head and tail are running byte counts (never
+// wrapped); the data area that follows the header has a power-of-two capacity.
+//
+// Doorbells: a side that is about to sleep sets its *Waiting flag, re-checks the
+// ring and only then blocks on its eventfd. The other side clears the flag with an
+// exchange after publishing and rings the eventfd only if it was set, so no
+// syscall is made while the peer is actively polling.
+struct SharedRingHeader {
+    alignas(64) std::atomic<uint64_t> head;             // Written by the producer
+    alignas(64) std::atomic<uint64_t> tail;             // Written by the consumer
+    alignas(64) std::atomic<uint32_t> consumerWaiting;  // Consumer sleeps until data arrives
+    std::atomic<uint32_t> producerWaiting;              // Producer sleeps until space frees up
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared rings need lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared rings need lock-free 32-bit atomics");
+
+// head and tail in shared memory describe no state a ring can be in: the peer is
+// buggy or hostile, and the ring must not be touched any more
+class SharedRingCorruptedError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class SharedRing {
+public:
+    // Bytes of shared memory needed for a ring of the given capacity
+    static constexpr size_t footprint(size_t capacity) {
+        return sizeof(SharedRingHeader) + capacity;
+    }
+
+    SharedRing() = default;
+
+    // base must point at footprint(capacity) bytes; capacity must be a power of two.
+    // The creator of the memory calls initialise() once before handing it out.
+    SharedRing(void* base, size_t capacity)
+        : header_(static_cast<SharedRingHeader*>(base)),
+          data_(static_cast<char*>(base) + sizeof(SharedRingHeader)),
+          capacity_(capacity) {}
+
+    void initialise() {
+        new (header_) SharedRingHeader();
+        header_->head.store(0, std::memory_order_relaxed);
+        header_->tail.store(0, std::memory_order_relaxed);
+        header_->consumerWaiting.store(0, std::memory_order_relaxed);
+        header_->producerWaiting.store(0, std::memory_order_relaxed);
+    }
+
+    // Producer: copy as many bytes as fit and publish them. Returns the count copied.
+    // Throws SharedRingCorruptedError if the peer broke the indices.
+    size_t write(const char* bytes, size_t size) {
+        uint64_t head = header_->head.load(std::memory_order_relaxed);
+        uint64_t tail = header_->tail.load(std::memory_order_acquire);
+        checkIndices(head, tail);
+        size_t count = std::min<size_t>(size, capacity_ - static_cast<size_t>(head - tail));
+        if (count == 0) {
+            return 0;
+        }
+
+        size_t offset = static_cast<size_t>(head & (capacity_ - 1));
+        size_t first = std::min(count, capacity_ - offset);
+        std::memcpy(data_ + offset, bytes, first);
+        std::memcpy(data_, bytes + first, count - first);
+
+        header_->head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: append every published byte to out. Returns the count consumed.
+    // Throws SharedRingCorruptedError if the peer broke the indices.
+    size_t read(std::string& out) {
+        uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+        uint64_t head = header_->head.load(std::memory_order_acquire);
+        checkIndices(head, tail);
+        size_t count = static_cast<size_t>(head - tail);
+        if (count == 0) {
+            return 0;
+        }
+
+        size_t offset = static_cast<size_t>(tail & (capacity_ - 1));
+        size_t first = std::min(count, capacity_ - offset);
+        out.append(data_ + offset, first);
+        out.append(data_, count - first);
+
+        header_->tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    bool empty() const {
+        return header_->head.load(std::memory_order_acquire) == header_->tail.load(std::memory_order_acquire);
+    }
+
+    bool full() const {
+        return header_->head.load(std::memory_order_acquire) - header_->tail.load(std::memory_order_acquire) == capacity_;
+    }
+
+    // Producer, after write(): true if the consumer went to sleep and must be woken
+    bool consumerNeedsWakeup() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return header_->consumerWaiting.exchange(0, std::memory_order_acq_rel) != 0;
+    }
+
+    // Consumer, after read(): true if the producer is waiting for space
+    bool producerNeedsWakeup() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return header_->producerWaiting.exchange(0, std::memory_order_acq_rel) != 0;
+    }
+
+    // Consumer, before sleeping: returns false if data raced in and it must not sleep
+    bool prepareConsumerSleep() {
+        header_->consumerWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!empty()) {
+            header_->consumerWaiting.store(0, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Producer, before waiting for space: returns false if space freed up meanwhile
+    bool prepareProducerSleep() {
+        header_->producerWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!full()) {
+            header_->producerWaiting.store(0, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    void cancelConsumerSleep() {
+        header_->consumerWaiting.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    // Both indices live in memory the peer can write, our own included, so each is
+    // loaded once and checked before it is used to address the data area
+    void checkIndices(uint64_t head, uint64_t tail) const {
+        if (tail > head || head - tail > capacity_) {
+            throw SharedRingCorruptedError("shared ring indices out of range: head " + std::to_string(head) +
+                                           ", tail " + std::to_string(tail));
+        }
+    }
+
+    SharedRingHeader* header_{nullptr};
+    char* data_{nullptr};
+    size_t capacity_{0};
+};
+
+#endif  // SHARED_RING_H
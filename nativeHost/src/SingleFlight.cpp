@@ -0,0 +1,119 @@
+#include "SingleFlight.h"
+
+#include <optional>
+#include <utility>
+
+using json = nlohmann::json;
+
+SingleFlight::SingleFlight(TimerWheel& timers) : timers(timers) {}
+
+void SingleFlight::run(const std::string& action, const std::string& key, const std::shared_ptr<RequestContext>& context,
+                       Reply reply, Work work) {
+    std::shared_ptr<Flight> flight;
+    uint64_t waiterId;
+    bool leader = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto existing = flights.find(key);
+        if (existing != flights.end() && lastsLongEnough(*existing->second, *context)) {
+            flight = existing->second;
+            ++joined;
+        } else {
+            // A shorter execution may still be in flight for its own waiters; this
+            // one is what later requests join
+            flight = std::make_shared<Flight>();
+            flight->action = action;
+            flight->key = key;
+            flight->context = std::make_shared<RequestContext>(context->deadline());
+            flights[key] = flight;
+            leader = true;
+            ++executions;
+        }
+
+        waiterId = flight->nextWaiterId++;
+        Waiter& waiter = flight->waiters[waiterId];
+        waiter.reply = std::move(reply);
+        waiter.timer = 0;
+        if (context->deadline().has_value()) {
+            waiter.timer = timers.schedule(context->deadline().value(), [this, flight, waiterId] {
+                abandon(flight, waiterId, "deadline exceeded");
+            });
+        }
+    }
+
+    context->setCancelHook([this, flight, waiterId] { abandon(flight, waiterId, "cancelled"); });
+    if (leader) {
+        work(flight->context, [this, flight](SharedMessagePtr response) { complete(flight, response); });
+    }
+}
+
+SingleFlight::Statistics SingleFlight::statistics() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return Statistics{executions.load(), joined.load(), flights.size()};
+}
+
+void SingleFlight::complete(const std::shared_ptr<Flight>& flight, const SharedMessagePtr& response) {
+    std::map<uint64_t, Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        waiters.swap(flight->waiters);
+        auto current = flights.find(flight->key);
+        if (current != flights.end() && current->second == flight) {
+            flights.erase(current);
+        }
+        for (const auto& waiter : waiters) {
+            if (waiter.second.timer != 0) {
+                timers.cancel(waiter.second.timer);
+            }
+        }
+    }
+
+    for (auto& waiter : waiters) {
+        waiter.second.reply(response);
+    }
+}
+
+void SingleFlight::abandon(const std::shared_ptr<Flight>& flight, uint64_t waiterId, const std::string& error) {
+    std::optional<Waiter> waiter;
+    bool deserted = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = flight->waiters.find(waiterId);
+        if (found == flight->waiters.end()) {
+            return;
+        }
+        waiter = std::move(found->second);
+        flight->waiters.erase(found);
+        if (waiter->timer != 0) {
+            timers.cancel(waiter->timer);
+        }
+
+        // Nobody is left to answer: stop the work and let new requests start afresh
+        if (flight->waiters.empty()) {
+            deserted = true;
+            auto current = flights.find(flight->key);
+            if (current != flights.end() && current->second == flight) {
+                flights.erase(current);
+            }
+        }
+    }
+
+    json response;
+    response["action"] = flight->action;
+    response["data"] = "";
+    response["error"] = error;
+    waiter->reply(makeSharedMessage(std::move(response)));
+
+    if (deserted) {
+        flight->context->cancel();
+    }
+}
+
+// The waiter must not be cut short by the execution's own deadline
+bool SingleFlight::lastsLongEnough(const Flight& flight, const RequestContext& context) {
+    auto flightDeadline = flight.context->deadline();
+    if (!flightDeadline.has_value()) {
+        return true;
+    }
+    return context.deadline().has_value() && flightDeadline.value() >= context.deadline().value();
+}
@@ -0,0 +1,78 @@
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "RequestContext.hpp"
+#include "SharedMessage.hpp"
+#include "TimerWheel.h"
+
+// Coalesces identical requests that are in flight at the same time: the first one
+// for an action starts the work, later ones attach as waiters, and all of them get
+// the response of that single execution, the very same SharedMessage, so it is
+// serialized once however many requests it answers. Each waiter keeps its own
+// deadline and can be cancelled on its own; the work is cancelled once nobody
+// waits for it.
+class SingleFlight {
+public:
+    using Reply = std::function<void(SharedMessagePtr response)>;
+    // Produces the response once and calls done with it. context carries the
+    // deadline of the whole execution and is cancelled when every waiter left.
+    using Work = std::function<void(const std::shared_ptr<RequestContext>& context, Reply done)>;
+
+    // Waiter deadlines are timers on timers, so whoever advances it drives them
+    explicit SingleFlight(TimerWheel& timers);
+
+    // Joins the execution of action in flight if it runs at least as long as context
+    // may wait, otherwise starts work. reply is called exactly once: with the shared
+    // response, or with an error if context expires or is cancelled first.
+    void run(const std::string& action, const std::shared_ptr<RequestContext>& context, Reply reply, Work work) {
+        run(action, action, context, std::move(reply), std::move(work));
+    }
+
+    // Same, but only requests with the same key share an execution, e.g. the action
+    // plus the version of the state it reads, so requests made after that state
+    // changed never join an execution started before
+    void run(const std::string& action, const std::string& key, const std::shared_ptr<RequestContext>& context,
+             Reply reply, Work work);
+
+    struct Statistics {
+        uint64_t executions;   // Times work ran
+        uint64_t joined;       // Requests answered by an execution another one started
+        size_t inFlight;
+    };
+
+    Statistics statistics();
+
+private:
+    struct Waiter {
+        Reply reply;
+        TimerWheel::TimerId timer;   // 0 without a deadline
+    };
+
+    struct Flight {
+        std::string action;
+        std::string key;
+        std::shared_ptr<RequestContext> context;
+        uint64_t nextWaiterId{0};
+        std::map<uint64_t, Waiter> waiters;
+    };
+
+    void complete(const std::shared_ptr<Flight>& flight, const SharedMessagePtr& response);
+    void abandon(const std::shared_ptr<Flight>& flight, uint64_t waiterId, const std::string& error);
+    static bool lastsLongEnough(const Flight& flight, const RequestContext& context);
+
+    TimerWheel& timers;
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<Flight>> flights;   // By key, the execution new requests join
+    std::atomic<uint64_t> executions{0};
+    std::atomic<uint64_t> joined{0};
+};
+
+#endif  // SINGLE_FLIGHT_H
@@ -0,0 +1,165 @@
+#include "TimerWheel.h"
+#include "Logger.hpp"
+
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace {
+    inline void logError(const std::string& errorMessage) {
+        LOG_TAGGED_ERROR(Logger::LogTag::GENERAL, errorMessage);
+    }
+}
+
+TimerWheel::TimerWheel(Clock::time_point start) : start(start) {}
+
+TimerWheel::TimerId TimerWheel::schedule(Clock::time_point deadline, Callback callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    TimerId id = nextId++;
+    place(Entry{id, toDeadlineTick(deadline), std::move(callback)});
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto location = locations.find(id);
+    if (location == locations.end()) {
+        return false;
+    }
+    wheels[location->second.level][location->second.slot].erase(location->second.entry);
+    locations.erase(location);
+    return true;
+}
+
+size_t TimerWheel::advance(Clock::time_point now) {
+    std::vector<Callback> due;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t target = toTick(now);
+
+        // Nothing pending: no slot needs visiting on the way
+        if (locations.empty() && target > currentTick) {
+            currentTick = target;
+        }
+
+        while (currentTick < target) {
+            ++currentTick;
+
+            // Re-file the next outer slot whenever an inner wheel wraps around
+            for (int level = 1; level < LEVELS; ++level) {
+                if ((currentTick & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0) {
+                    break;
+                }
+                cascade(level);
+            }
+
+            auto& slot = wheels[0][currentTick & SLOT_MASK];
+            for (auto& entry : slot) {
+                locations.erase(entry.id);
+                due.push_back(std::move(entry.callback));
+            }
+            slot.clear();
+
+            if (locations.empty() && target > currentTick) {
+                currentTick = target;
+            }
+        }
+    }
+
+    for (auto& callback : due) {
+        try {
+            callback();
+        } catch (const std::exception& ex) {
+            logError("Timer callback failed: " + std::string(ex.what()));
+        }
+    }
+    return due.size();
+}
+
+std::optional<std::chrono::milliseconds> TimerWheel::nextExpiry(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (locations.empty()) {
+        return std::nullopt;
+    }
+
+    uint64_t nowTick = toTick(now);
+    uint64_t elapsed = nowTick > currentTick ? nowTick - currentTick : 0;
+
+    // The first occupied innermost slot is exact; otherwise the next wrap of the
+    // innermost wheel is the earliest a cascade can bring something due
+    uint64_t ticks = SLOTS - (currentTick & SLOT_MASK);
+    for (uint64_t offset = 1; offset <= SLOTS; ++offset) {
+        if (!wheels[0][(currentTick + offset) & SLOT_MASK].empty()) {
+            ticks = offset;
+            break;
+        }
+    }
+    return std::chrono::milliseconds(ticks > elapsed ? ticks - elapsed : 0);
+}
+
+size_t TimerWheel::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return locations.size();
+}
+
+uint64_t TimerWheel::toTick(Clock::time_point time) const {
+    if (time <= start) {
+        return 0;
+    }
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time - start).count());
+}
+
+uint64_t TimerWheel::toDeadlineTick(Clock::time_point time) const {
+    if (time <= start) {
+        return 0;
+    }
+    return static_cast<uint64_t>(std::chrono::ceil<std::chrono::milliseconds>(time - start).count());
+}
+
+void TimerWheel::place(Entry entry) {
+    // Due now or overdue: the next tick fires it
+    if (entry.expiryTick <= currentTick) {
+        entry.expiryTick = currentTick + 1;
+    }
+    insert(std::move(entry));
+}
+
+void TimerWheel::insert(Entry entry) {
+    uint64_t delta = entry.expiryTick - currentTick;
+    uint64_t expiry = entry.expiryTick;
+    if (delta > MAX_DELTA) {
+        // Beyond the wheel: park at its far end, re-filed again when cascaded down
+        expiry = currentTick + MAX_DELTA;
+        delta = MAX_DELTA;
+    }
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    uint64_t slot = (expiry >> (SLOT_BITS * level)) & SLOT_MASK;
+
+    auto& list = wheels[level][slot];
+    TimerId id = entry.id;
+    list.push_back(std::move(entry));
+    locations[id] = Location{level, slot, std::prev(list.end())};
+}
+
+void TimerWheel::cascade(int level) {
+    uint64_t slot = (currentTick >> (SLOT_BITS * level)) & SLOT_MASK;
+    Slot entries;
+    entries.swap(wheels[level][slot]);
+    for (auto& entry : entries) {
+        locations.erase(entry.id);
+        // Cascading runs before the current innermost slot fires, so an entry due
+        // on this very tick still makes it
+        if (entry.expiryTick <= currentTick) {
+            auto& list = wheels[0][currentTick & SLOT_MASK];
+            TimerId id = entry.id;
+            list.push_back(std::move(entry));
+            locations[id] = Location{0, currentTick & SLOT_MASK, std::prev(list.end())};
+        } else {
+            insert(std::move(entry));
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+// Hierarchical timer wheel: four levels of 64 slots with a 1 ms tick cover about
+// 4.6 hours, anything later is parked in the outermost slot and re-filed as time
+// passes. schedule() and cancel() are O(1); advance() touches one slot per elapsed
+// tick plus an occasional cascade, so tens of thousands of pending timers cost
+// nothing until they are due.
+//
+// Thread-safe. Callbacks run on the thread calling advance(), outside the lock, so
+// they may schedule or cancel timers themselves.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimerId = uint64_t;
+    using Callback = std::function<void()>;
+
+    explicit TimerWheel(Clock::time_point start = Clock::now());
+
+    // Fires on the first advance() at or after deadline, never before it: deadlines
+    // between ticks are rounded up to the next one. Deadlines in the past fire on the
+    // next advance().
+    TimerId schedule(Clock::time_point deadline, Callback callback);
+
+    TimerId scheduleAfter(Clock::duration delay, Callback callback) {
+        return schedule(Clock::now() + delay, std::move(callback));
+    }
+
+    // False if the timer already fired or was cancelled
+    bool cancel(TimerId id);
+
+    // Fires every timer due at or before now; returns how many fired
+    size_t advance(Clock::time_point now = Clock::now());
+
+    // How long the driving loop may sleep before advance() has work, or std::nullopt
+    // when no timer is pending. May be early (higher levels are only approximated),
+    // never late.
+    std::optional<std::chrono::milliseconds> nextExpiry(Clock::time_point now = Clock::now());
+
+    size_t size();
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr uint64_t SLOTS = uint64_t(1) << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint64_t MAX_DELTA = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+
+    struct Entry {
+        TimerId id;
+        uint64_t expiryTick;
+        Callback callback;
+    };
+
+    using Slot = std::list<Entry>;
+
+    struct Location {
+        int level;
+        uint64_t slot;
+        Slot::iterator entry;
+    };
+
+    uint64_t toTick(Clock::time_point time) const;           // Last tick at or before time
+    uint64_t toDeadlineTick(Clock::time_point time) const;   // First tick at or after time
+    void place(Entry entry);
+    void insert(Entry entry);
+    void cascade(int level);
+
+    Clock::time_point start;
+    uint64_t currentTick{0};
+    TimerId nextId{1};
+    std::array<std::array<Slot, SLOTS>, LEVELS> wheels;
+    std::unordered_map<TimerId, Location> locations;
+    std::mutex mutex;
+};
+
+#endif  // TIMER_WHEEL_H
@@ -0,0 +1,312 @@
+#include "UnixSocketPipeServer.h"
+#include "Logger.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    inline void logError(const std::string& errorMessage) {
+        LOG_TAGGED_ERROR(Logger::LogTag::PIPE_SERVER, errorMessage);
+    }
+
+    inline void logInfo(const std::string& infoMessage) {
+        LOG_TAGGED_INFO(Logger::LogTag::PIPE_SERVER, infoMessage);
+    }
+
+    // epoll tokens for the two non-client descriptors; client ids start at 1
+    constexpr uint64_t LISTEN_TOKEN = 0;
+    constexpr uint64_t WAKEUP_TOKEN = UINT64_MAX;
+
+    constexpr int EPOLL_WAIT_TIMEOUT_MILLISECONDS = 1000;
+    constexpr int MAX_EPOLL_EVENTS = 64;
+    constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+    // A client that lets this much output pile up is considered stalled and dropped
+    constexpr size_t MAX_PENDING_OUTPUT = 8 * 1024 * 1024;
+
+    std::string errnoString() {
+        return std::string(strerror(errno));
+    }
+}
+
+UnixSocketPipeServer::UnixSocketPipeServer(const std::string& socketPath) : socketPath(socketPath) {}
+
+UnixSocketPipeServer::~UnixSocketPipeServer() {
+    try {
+        stop();
+    } catch (const std::exception& ex) {
+        logError("Exception: " + std::string(ex.what()));
+    }
+}
+
+void UnixSocketPipeServer::start() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: '" + socketPath + "'");
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    if (unlink(socketPath.c_str()) == -1 && errno != ENOENT) {
+        throw std::runtime_error("Error unlinking existing socket '" + socketPath + "': " + errnoString());
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd == -1) {
+        throw std::runtime_error("Error creating socket: " + errnoString());
+    }
+
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        throw std::runtime_error("Error binding socket '" + socketPath + "': " + errnoString());
+    }
+
+    // Same access rights the FIFO transport grants
+    chmod(socketPath.c_str(), 0666);
+
+    if (listen(listenFd, SOMAXCONN) == -1) {
+        throw std::runtime_error("Error listening on socket '" + socketPath + "': " + errnoString());
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || wakeupFd == -1) {
+        throw std::runtime_error("Error creating epoll/eventfd: " + errnoString());
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = LISTEN_TOKEN;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    event.data.u64 = WAKEUP_TOKEN;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event);
+
+    logInfo("Listening on '" + socketPath + "'");
+}
+
+void UnixSocketPipeServer::stop() {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    while (!connections.empty()) {
+        closeClientLocked(connections.begin()->first);
+    }
+    closedClients.clear();
+
+    for (int* fd : {&listenFd, &epollFd, &wakeupFd}) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+
+    if (unlink(socketPath.c_str()) == -1 && errno != ENOENT) {
+        throw std::runtime_error("Error unlinking socket '" + socketPath + "': " + errnoString());
+    }
+}
+
+std::vector<PipeClientData> UnixSocketPipeServer::readData() {
+    std::vector<PipeClientData> result;
+    if (epollFd == -1) {
+        return result;
+    }
+
+    epoll_event events[MAX_EPOLL_EVENTS];
+    int count = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, EPOLL_WAIT_TIMEOUT_MILLISECONDS);
+    if (count == -1) {
+        if (errno == EINTR) {
+            return result;
+        }
+        throw std::runtime_error("Error waiting on socket '" + socketPath + "': " + errnoString());
+    }
+
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    for (PipeClientId client : closedClients) {
+        result.push_back(PipeClientData{PipeClientData::Kind::Disconnected, client, std::string()});
+    }
+    closedClients.clear();
+    for (int i = 0; i < count; ++i) {
+        uint64_t token = events[i].data.u64;
+
+        if (token == WAKEUP_TOKEN) {
+            eventfd_t value;
+            eventfd_read(wakeupFd, &value);
+            continue;
+        }
+
+        if (token == LISTEN_TOKEN) {
+            acceptClients(result);
+            continue;
+        }
+
+        auto connection = connections.find(token);
+        if (connection == connections.end()) {
+            continue;
+        }
+
+        if (events[i].events & EPOLLOUT) {
+            flushClient(token, connection->second);
+        }
+
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
+            readClient(token, result);
+        }
+    }
+    return result;
+}
+
+void UnixSocketPipeServer::writeData(PipeClientId client, std::initializer_list<PipeBuffer> buffers) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    auto connection = connections.find(client);
+    if (connection == connections.end()) {
+        return;
+    }
+
+    auto& pending = connection->second.pendingOutput;
+    size_t size = 0;
+    for (const auto& buffer : buffers) {
+        size += buffer->size();
+    }
+    if (pending.size() + size > MAX_PENDING_OUTPUT) {
+        logError("Client " + std::to_string(client) + " is not reading, dropping it");
+        // The epoll loop sees the hangup and reports the disconnect
+        shutdown(connection->second.fd, SHUT_RDWR);
+        return;
+    }
+
+    for (const auto& buffer : buffers) {
+        pending.push(buffer);
+    }
+    flushClient(client, connection->second);
+}
+
+void UnixSocketPipeServer::closeClient(PipeClientId client) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    if (connections.count(client) == 0) {
+        return;
+    }
+    closeClientLocked(client);
+    closedClients.push_back(client);
+    wakeup();
+}
+
+size_t UnixSocketPipeServer::outputBacklog(PipeClientId client) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    auto connection = connections.find(client);
+    return connection != connections.end() ? connection->second.pendingOutput.size() : 0;
+}
+
+void UnixSocketPipeServer::wakeup() {
+    if (wakeupFd != -1) {
+        eventfd_write(wakeupFd, 1);
+    }
+}
+
+void UnixSocketPipeServer::acceptClients(std::vector<PipeClientData>& events) {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                logError("Error accepting client: " + errnoString());
+            }
+            return;
+        }
+
+        PipeClientId client = nextClientId++;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = client;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            logError("Error registering client: " + errnoString());
+            close(fd);
+            continue;
+        }
+
+        connections.emplace(client, Connection{fd, PipeOutputQueue(), false});
+        events.push_back(PipeClientData{PipeClientData::Kind::Connected, client, std::string()});
+    }
+}
+
+void UnixSocketPipeServer::readClient(PipeClientId client, std::vector<PipeClientData>& events) {
+    int fd = connections.at(client).fd;
+    std::string bytes;
+    bool closed = false;
+
+    while (true) {
+        size_t offset = bytes.size();
+        bytes.resize(offset + READ_BUFFER_SIZE);
+        ssize_t bytesRead = read(fd, &bytes[offset], READ_BUFFER_SIZE);
+
+        if (bytesRead > 0) {
+            bytes.resize(offset + static_cast<size_t>(bytesRead));
+            continue;
+        }
+
+        bytes.resize(offset);
+        if (bytesRead == -1 && errno == EINTR) {
+            continue;
+        }
+        closed = bytesRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+
+    if (!bytes.empty()) {
+        events.push_back(PipeClientData{PipeClientData::Kind::Data, client, std::move(bytes)});
+    }
+
+    if (closed) {
+        closeClientLocked(client);
+        events.push_back(PipeClientData{PipeClientData::Kind::Disconnected, client, std::string()});
+    }
+}
+
+void UnixSocketPipeServer::flushClient(PipeClientId client, Connection& connection) {
+    auto& pending = connection.pendingOutput;
+
+    while (!pending.empty()) {
+        // sendmsg rather than writev for MSG_NOSIGNAL
+        iovec iov[PipeOutputQueue::MAX_IOVECS];
+        msghdr message{};
+        message.msg_iov = iov;
+        message.msg_iovlen = static_cast<size_t>(pending.fill(iov, PipeOutputQueue::MAX_IOVECS));
+        ssize_t bytesWritten = sendmsg(connection.fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (bytesWritten == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                logError("Error writing to client " + std::to_string(client) + ": " + errnoString());
+                shutdown(connection.fd, SHUT_RDWR);
+                pending.clear();
+                return;
+            }
+            break;
+        }
+        pending.consume(static_cast<size_t>(bytesWritten));
+    }
+
+    // Only ask for writability while there is something left to write
+    bool wantWrite = !pending.empty();
+    if (wantWrite != connection.writeArmed) {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.u64 = client;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.writeArmed = wantWrite;
+    }
+}
+
+void UnixSocketPipeServer::closeClientLocked(PipeClientId client) {
+    auto connection = connections.find(client);
+    if (connection == connections.end()) {
+        return;
+    }
+    close(connection->second.fd);
+    connections.erase(connection);
+}
@@ -0,0 +1,52 @@
+#ifndef UNIX_SOCKET_PIPE_SERVER_H
+#define UNIX_SOCKET_PIPE_SERVER_H
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "PipeServerInterface.h"
+
+// PipeServerInterface over a SOCK_STREAM Unix domain socket. Any number of clients
+// can connect; one epoll loop (driven by readData) accepts them, reads their bytes
+// and flushes output that could not be written immediately.
+class UnixSocketPipeServer : public PipeServerInterface {
+public:
+    explicit UnixSocketPipeServer(const std::string& socketPath);
+    ~UnixSocketPipeServer() override;
+
+    void start() override;
+    void stop() override;
+    std::vector<PipeClientData> readData() override;
+    void writeData(PipeClientId client, std::initializer_list<PipeBuffer> buffers) override;
+    void closeClient(PipeClientId client) override;
+    size_t outputBacklog(PipeClientId client) override;
+    void wakeup() override;
+
+private:
+    struct Connection {
+        int fd;
+        PipeOutputQueue pendingOutput;   // Bytes the socket did not accept yet
+        bool writeArmed;             // EPOLLOUT registered while pendingOutput is non-empty
+    };
+
+    void acceptClients(std::vector<PipeClientData>& events);
+    void readClient(PipeClientId client, std::vector<PipeClientData>& events);
+    void flushClient(PipeClientId client, Connection& connection);
+    void closeClientLocked(PipeClientId client);
+
+    UnixSocketPipeServer(const UnixSocketPipeServer&) = delete;
+    UnixSocketPipeServer& operator=(const UnixSocketPipeServer&) = delete;
+
+    std::string socketPath;
+    int listenFd{-1};
+    int epollFd{-1};
+    int wakeupFd{-1};
+    PipeClientId nextClientId{1};
+    std::mutex connectionsMutex;
+    std::map<PipeClientId, Connection> connections;
+    // Dropped by closeClient, reported as disconnected by the next readData
+    std::vector<PipeClientId> closedClients;
+};
+
+#endif  // UNIX_SOCKET_PIPE_SERVER_H
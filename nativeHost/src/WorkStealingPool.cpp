@@ -0,0 +1,156 @@
+#include "WorkStealingPool.h"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <string>
+
+namespace {
+    inline void logError(const std::string& errorMessage) {
+        LOG_TAGGED_ERROR(Logger::LogTag::GENERAL, errorMessage);
+    }
+
+    // Index of the pool worker running on this thread, if any
+    thread_local const WorkStealingPool* currentPool = nullptr;
+    thread_local size_t currentWorker = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t workerCount) {
+    if (workerCount == 0) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < workerCount; ++i) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    stop();
+}
+
+void WorkStealingPool::submit(Task task) {
+    uint64_t current = state.load();
+    do {
+        if (current & STOPPING) {
+            return;
+        }
+    } while (!state.compare_exchange_weak(current, current + 1));
+
+    // A continuation stays on the worker that produced it, while its data is still hot
+    size_t index = currentPool == this ? currentWorker : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+
+    // The count went up before sleepers is read and a parking worker counts itself
+    // before it checks the count, so either it sees the task or we see it asleep
+    if (sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idleCondition.notify_one();
+    }
+}
+
+void WorkStealingPool::stop() {
+    if (state.fetch_or(STOPPING) & STOPPING) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idleCondition.notify_all();
+    }
+
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+size_t WorkStealingPool::workerCount() const {
+    return queues.size();
+}
+
+WorkStealingPool::Metrics WorkStealingPool::metrics() {
+    Metrics result{{}, executed.load(std::memory_order_relaxed), steals.load(std::memory_order_relaxed)};
+    for (auto& queue : queues) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        result.queueLengths.push_back(queue->tasks.size());
+    }
+    return result;
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentWorker = index;
+
+    while (true) {
+        if (!claimTask()) {
+            std::unique_lock<std::mutex> lock(idleMutex);
+            sleepers.fetch_add(1);
+            idleCondition.wait(lock, [this] { return state.load() != 0; });
+            sleepers.fetch_sub(1);
+            if (state.load() == STOPPING) {
+                // Stopping and everything submitted has been taken
+                return;
+            }
+            continue;
+        }
+
+        // The claim guarantees one task exists somewhere, but its submitter may not
+        // have pushed it yet, or a racing worker took it from the deque this one looks
+        // at first, so keep looking
+        Task task;
+        while (!popLocal(index, task) && !steal(index, task)) {
+            std::this_thread::yield();
+        }
+
+        try {
+            task();
+        } catch (const std::exception& ex) {
+            logError("Pool task failed: " + std::string(ex.what()));
+        }
+        executed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Takes one of the submitted tasks off the count, false if there is none
+bool WorkStealingPool::claimTask() {
+    uint64_t current = state.load();
+    while ((current & ~STOPPING) != 0) {
+        if (state.compare_exchange_weak(current, current - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingPool::popLocal(size_t index, Task& task) {
+    auto& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t thief, Task& task) {
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        auto& queue = *queues[(thief + offset) % queues.size()];
+        std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || queue.tasks.empty()) {
+            continue;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
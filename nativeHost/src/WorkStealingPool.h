@@ -0,0 +1,71 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Thread pool for CPU-heavy work. Every worker owns a deque: tasks a worker submits
+// (continuations) go to its own deque and are taken newest first, while idle
+// workers steal the oldest task from the others. Tasks submitted from outside the
+// pool are spread round-robin over the deques.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    struct Metrics {
+        std::vector<size_t> queueLengths;   // Per worker, at the time of the call
+        uint64_t executed;
+        uint64_t steals;
+    };
+
+    // 0 workers means std::thread::hardware_concurrency()
+    explicit WorkStealingPool(size_t workers = 0);
+    ~WorkStealingPool();
+
+    void submit(Task task);
+
+    // Runs every task already submitted, then joins the workers. Tasks submitted
+    // afterwards are dropped.
+    void stop();
+
+    size_t workerCount() const;
+
+    Metrics metrics();
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool claimTask();
+    bool popLocal(size_t index, Task& task);
+    bool steal(size_t thief, Task& task);
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> steals{0};
+    // Tasks submitted but not yet taken, plus STOPPING once stop() was called. Only
+    // parking and waking idle workers takes idleMutex.
+    static constexpr uint64_t STOPPING = uint64_t(1) << 63;
+    std::atomic<uint64_t> state{0};
+    std::atomic<size_t> sleepers{0};
+    std::mutex idleMutex;
+    std::condition_variable idleCondition;
+};
+
+#endif  // WORK_STEALING_POOL_H
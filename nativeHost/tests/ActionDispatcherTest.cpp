@@ -0,0 +1,88 @@
+// Requests without a string action, alone or in a batch, are answered with an
+// error, never reach a handler and never throw out of the dispatcher
+
+#include "ActionDispatcher.h"
+#include "TestCheck.hpp"
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+    // Dispatches request and returns the reply, which must have come synchronously
+    std::optional<json> dispatchNow(ActionDispatcher& dispatcher, const json& request) {
+        std::optional<json> response;
+        try {
+            dispatcher.dispatch(request, std::make_shared<RequestContext>(), [&response](SharedMessagePtr reply) {
+                response = reply->value();
+            });
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+        return response;
+    }
+}
+
+int main() {
+    ActionDispatcher dispatcher;
+    int handled = 0;
+    dispatcher.registerHandler("ping", ActionDispatcher::HandlerKind::Local,
+                               [&handled](const json&, const std::shared_ptr<RequestContext>&, ActionDispatcher::Reply reply) {
+                                   ++handled;
+                                   reply(makeSharedMessage(json{{"action", "ping"}, {"data", "pong"}}));
+                               });
+    dispatcher.setFallbackHandler(ActionDispatcher::HandlerKind::Local,
+                                  [&handled](const json&, const std::shared_ptr<RequestContext>&, ActionDispatcher::Reply reply) {
+                                      ++handled;
+                                      reply(makeSharedMessage(json{{"data", "forwarded"}}));
+                                  });
+
+    auto pong = dispatchNow(dispatcher, json{{"action", "ping"}});
+    CHECK(pong.has_value() && pong->value("data", "") == "pong");
+    CHECK(handled == 1);
+
+    for (const json& request : {json{{"action", 5}}, json{{"action", nullptr}}, json{{"action", json::array()}},
+                                json{{"action", ""}}, json{{"other", "ping"}}, json("ping"), json(42)}) {
+        auto response = dispatchNow(dispatcher, request);
+        CHECK(response.has_value());
+        if (response.has_value()) {
+            CHECK(response->value("error", "") == "missing action");
+            CHECK(response->value("action", "x") == "");
+        }
+    }
+    CHECK(handled == 1);
+
+    // A batch with items that have no string action: those items fail, the others
+    // are still answered, and the batch gets one reply
+    json batch = json::array({json{{"action", "ping"}}, json{{"action", 5}}, json(7), json{{"action", "other"}}});
+    std::vector<std::shared_ptr<RequestContext>> contexts;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        contexts.push_back(std::make_shared<RequestContext>());
+    }
+    int replies = 0;
+    json results;
+    try {
+        dispatcher.dispatchBatch(batch, contexts, [&replies, &results](SharedMessagePtr reply) {
+            ++replies;
+            results = reply->value();
+        });
+    } catch (const std::exception&) {
+        CHECK(!"dispatchBatch threw");
+    }
+    CHECK(replies == 1);
+    CHECK(results.is_array() && results.size() == 4);
+    if (results.is_array() && results.size() == 4) {
+        CHECK(results[0].value("status", "") == "ok" && results[0].value("data", "") == "pong");
+        CHECK(results[1].value("status", "") == "error" && results[1].value("error", "") == "missing action");
+        CHECK(results[2].value("status", "") == "error" && results[2].value("error", "") == "missing action");
+        CHECK(results[3].value("status", "") == "ok" && results[3].value("data", "") == "forwarded");
+    }
+    CHECK(handled == 3);
+
+    CHECK(ActionDispatcher::actionOf(json{{"action", "tabInfo"}}) == std::optional<std::string>("tabInfo"));
+    CHECK(!ActionDispatcher::actionOf(json{{"action", 1.5}}).has_value());
+
+    return TEST_RESULT();
+}
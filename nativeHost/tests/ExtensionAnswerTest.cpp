@@ -0,0 +1,32 @@
+// Only a round trip the extension answered successfully yields an answer, which
+// is what decides whether tabInfo responses are cached: failures reported by the
+// extension itself must not be served until the next tab change
+
+#include "ExtensionAnswer.hpp"
+#include "TestCheck.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+    // A forwarded response as the host builds it from the extension's frame
+    json forwarded(const json& frame) {
+        return json{{"action", "tabInfo"}, {"data", frame.dump()}};
+    }
+}
+
+int main() {
+    auto answer = extensionAnswer(forwarded({{"response", "tabInfo"}, {"id", 1}, {"data", {{"url", "https://example.com"}}}}));
+    CHECK(answer.has_value() && answer.value().value("url", "") == "https://example.com");
+
+    // The extension could not answer
+    CHECK(!extensionAnswer(forwarded({{"response", "tabInfo"}, {"id", 2}, {"data", {{"error", "No active tabs found"}}}})));
+    CHECK(!extensionAnswer(forwarded({{"response", "tabInfo"}, {"id", 3}, {"data", {{"error", "fail to message content script"}}}})));
+    CHECK(!extensionAnswer(forwarded({{"response", "tabInfo"}, {"id", 4}, {"data", nullptr}})));
+
+    // The round trip itself failed
+    CHECK(!extensionAnswer(json{{"action", "tabInfo"}, {"data", ""}, {"error", "timeout"}}));
+    CHECK(!extensionAnswer(json{{"action", "tabInfo"}, {"data", "{not json"}}));
+    CHECK(!extensionAnswer(json{{"action", "tabInfo"}}));
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,161 @@
+// The io_uring transport must serve exactly what the epoll transport serves:
+// clients are accepted and read, one shared buffer reaches several clients in
+// full, writes from another thread wake the loop, and a client that hangs up or
+// is dropped is reported as disconnected. Both transports run the same checks;
+// where io_uring is unavailable the factory must hand back the epoll transport.
+
+#include "IoUringPipeServer.h"
+#include "UnixSocketPipeServer.h"
+#include "TestCheck.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    // Polls the server until an event of the given kind shows up, collecting Data bytes
+    bool waitFor(PipeServerInterface& server, PipeClientData::Kind kind, PipeClientId& client,
+                 std::string* bytes = nullptr, size_t size = 0) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (std::chrono::steady_clock::now() < deadline) {
+            for (auto& data : server.readData()) {
+                if (client != 0 && data.client != client) {
+                    continue;
+                }
+                if (bytes != nullptr && data.kind == PipeClientData::Kind::Data) {
+                    bytes->append(data.bytes);
+                    if (bytes->size() >= size) {
+                        return true;
+                    }
+                } else if (data.kind == kind) {
+                    client = data.client;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    int connectClient(PipeServerInterface& server, const std::string& socketPath, PipeClientId& id) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+            || !waitFor(server, PipeClientData::Kind::Connected, id)) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Reads until size bytes arrived while another thread drives the server
+    std::string readAll(int fd, size_t size) {
+        std::string received;
+        char bytes[65536];
+        while (received.size() < size) {
+            ssize_t bytesRead = read(fd, bytes, sizeof(bytes));
+            if (bytesRead <= 0) {
+                break;
+            }
+            received.append(bytes, static_cast<size_t>(bytesRead));
+        }
+        return received;
+    }
+
+    void checkTransport(PipeServerInterface& server, const std::string& socketPath) {
+        server.start();
+
+        PipeClientId firstId = 0;
+        PipeClientId secondId = 0;
+        int first = connectClient(server, socketPath, firstId);
+        int second = connectClient(server, socketPath, secondId);
+        CHECK(first != -1 && second != -1);
+        CHECK(firstId != 0 && secondId != 0 && firstId != secondId);
+
+        // More than one provided buffer's worth arrives intact
+        std::string request(100000, 'r');
+        std::thread sender([first, &request] { (void)write(first, request.data(), request.size()); });
+        std::string received;
+        CHECK(waitFor(server, PipeClientData::Kind::Data, firstId, &received, request.size()));
+        CHECK(received == request);
+        sender.join();
+
+        // One buffer, larger than a socket's send buffer, shared by both clients and
+        // queued from another thread while the loop waits
+        auto header = std::make_shared<const std::string>("header");
+        auto payload = std::make_shared<const std::string>(std::string(1 << 20, 'p') + "end");
+        std::string expected = *header + *payload;
+        std::string firstReceived;
+        std::string secondReceived;
+        std::atomic<bool> readersDone{false};
+        std::thread readers([&] {
+            std::thread other([&] { secondReceived = readAll(second, expected.size()); });
+            firstReceived = readAll(first, expected.size());
+            other.join();
+            readersDone = true;
+            server.wakeup();
+        });
+        std::thread writer([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            server.writeData(firstId, {header, payload});
+            server.writeData(secondId, {header, payload});
+        });
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!readersDone && std::chrono::steady_clock::now() < deadline) {
+            server.readData();
+        }
+        writer.join();
+        readers.join();
+        CHECK(firstReceived == expected);
+        CHECK(secondReceived == expected);
+        CHECK(server.outputBacklog(firstId) == 0);
+
+        // Dropped by the server and hung up by the client: both are reported once
+        server.closeClient(firstId);
+        CHECK(waitFor(server, PipeClientData::Kind::Disconnected, firstId));
+        char byte;
+        CHECK(read(first, &byte, 1) == 0);
+        close(second);
+        CHECK(waitFor(server, PipeClientData::Kind::Disconnected, secondId));
+
+        // Writes to clients that are gone are ignored
+        server.writeData(firstId, {header});
+        server.writeData(secondId, {header});
+        server.wakeup();
+        server.readData();
+
+        // A client still connected at stop() does not keep it waiting
+        PipeClientId thirdId = 0;
+        int third = connectClient(server, socketPath, thirdId);
+        CHECK(third != -1);
+        server.stop();
+        CHECK(access(socketPath.c_str(), F_OK) == -1);
+        close(first);
+        close(third);
+    }
+}
+
+int main() {
+    std::string socketPath = "/tmp/IoUringPipeServerTest." + std::to_string(getpid());
+
+    UnixSocketPipeServer epoll(socketPath);
+    checkTransport(epoll, socketPath);
+
+    auto server = createIoUringPipeServer(socketPath);
+    CHECK(server != nullptr);
+    CHECK((dynamic_cast<UnixSocketPipeServer*>(server.get()) == nullptr) == ioUringPipeServerSupported());
+    if (!ioUringPipeServerSupported()) {
+        std::cerr << "io_uring unavailable, checked the epoll fallback only\n";
+    }
+    checkTransport(*server, socketPath);
+
+    return TEST_RESULT();
+}
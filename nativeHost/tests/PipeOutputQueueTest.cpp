@@ -0,0 +1,77 @@
+// Buffers queued for several clients are shared, not copied, and a pipe that
+// takes them in arbitrary partial writevs gets every byte exactly once, in order
+
+#include "PipeOutputQueue.hpp"
+#include "TestCheck.hpp"
+
+#include <cerrno>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+    // Writes what the pipe takes, then reads it back out
+    std::string flushThroughPipe(PipeOutputQueue& queue, int readFd, int writeFd) {
+        std::string received;
+        while (!queue.empty()) {
+            iovec iov[PipeOutputQueue::MAX_IOVECS];
+            int count = queue.fill(iov, PipeOutputQueue::MAX_IOVECS);
+            ssize_t written = writev(writeFd, iov, count);
+            if (written > 0) {
+                queue.consume(static_cast<size_t>(written));
+            }
+
+            char bytes[4096];
+            ssize_t bytesRead;
+            while ((bytesRead = read(readFd, bytes, sizeof(bytes))) > 0) {
+                received.append(bytes, static_cast<size_t>(bytesRead));
+            }
+        }
+        return received;
+    }
+}
+
+int main() {
+    auto header = std::make_shared<const std::string>("header");
+    auto payload = std::make_shared<const std::string>(std::string(100000, 'p') + "end");
+    auto empty = std::make_shared<const std::string>();
+
+    PipeOutputQueue first;
+    PipeOutputQueue second;
+    for (PipeOutputQueue* queue : {&first, &second}) {
+        queue->push(header);
+        queue->push(empty);
+        queue->push(payload);
+        queue->push(header);
+    }
+    CHECK(payload.use_count() == 3);
+    CHECK(first.size() == 2 * header->size() + payload->size());
+    CHECK(first.front() == "header");
+
+    // A partial consume leaves the rest of the first buffer in front
+    first.consume(2);
+    CHECK(first.front() == "ader");
+    CHECK(first.size() == 2 * header->size() + payload->size() - 2);
+
+    int fds[2];
+    CHECK(pipe2(fds, O_NONBLOCK) == 0);
+    // A small pipe forces writevs that end in the middle of a buffer
+    fcntl(fds[1], F_SETPIPE_SZ, 4096);
+
+    std::string expected = "ader" + *payload + *header;
+    CHECK(flushThroughPipe(first, fds[0], fds[1]) == expected);
+    CHECK(first.empty());
+    CHECK(payload.use_count() == 2);
+
+    second.clear();
+    CHECK(second.empty());
+    CHECK(second.front().empty());
+    CHECK(payload.use_count() == 1);
+
+    close(fds[0]);
+    close(fds[1]);
+    return TEST_RESULT();
+}
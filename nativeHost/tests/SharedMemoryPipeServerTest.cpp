@@ -0,0 +1,151 @@
+// A client that corrupts the ring indices in its shared memory must be dropped,
+// not make the host read or write outside the mapping, and cannot resize the
+// memory under the host's mapping either. Every client the server
+// drops is reported as disconnected, like one that hung up.
+
+#include "SharedMemoryPipeServer.h"
+#include "SharedRing.hpp"
+#include "TestCheck.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    struct TestClient {
+        int socketFd{-1};
+        int memoryFd{-1};
+        int serverDoorbell{-1};
+        SharedRingHeader* requests{nullptr};
+        SharedRingHeader* responses{nullptr};
+        uint64_t ringCapacity{0};
+    };
+
+    // Polls the server until client's event of the given kind shows up
+    bool waitFor(SharedMemoryPipeServer& server, PipeClientData::Kind kind, PipeClientId& client) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+        while (std::chrono::steady_clock::now() < deadline) {
+            for (const auto& data : server.readData()) {
+                if (data.kind == kind && (client == 0 || data.client == client)) {
+                    client = data.client;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Connects, lets the server accept, and maps the memory it hands over
+    TestClient connectClient(SharedMemoryPipeServer& server, const std::string& socketPath, PipeClientId& id) {
+        TestClient client;
+        client.socketFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+        if (connect(client.socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+            || !waitFor(server, PipeClientData::Kind::Connected, id)) {
+            return client;
+        }
+
+        SharedMemoryHandshake handshake{};
+        iovec iov{&handshake, sizeof(handshake)};
+        int fds[3] = {-1, -1, -1};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(client.socketFd, &message, 0) != static_cast<ssize_t>(sizeof(handshake))) {
+            return client;
+        }
+        std::memcpy(fds, CMSG_DATA(CMSG_FIRSTHDR(&message)), sizeof(fds));
+
+        client.ringCapacity = handshake.ringCapacity;
+        client.memoryFd = fds[0];
+        client.serverDoorbell = fds[1];
+        size_t footprint = SharedRing::footprint(handshake.ringCapacity);
+        void* mapping = mmap(nullptr, 2 * footprint, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        if (mapping != MAP_FAILED) {
+            client.requests = static_cast<SharedRingHeader*>(mapping);
+            client.responses = reinterpret_cast<SharedRingHeader*>(static_cast<char*>(mapping) + footprint);
+        }
+        return client;
+    }
+
+    // The server closed its end: the socket reads end-of-file
+    bool closedByServer(const TestClient& client) {
+        char byte;
+        return recv(client.socketFd, &byte, 1, 0) == 0;
+    }
+}
+
+int main() {
+    std::string socketPath = "/tmp/native-host-shm-test-" + std::to_string(getpid()) + ".sock";
+    SharedMemoryPipeServer server(socketPath, 4096);
+    server.start();
+
+    // A request ring whose head runs further ahead of its tail than the ring is long
+    {
+        PipeClientId id = 0;
+        TestClient client = connectClient(server, socketPath, id);
+        CHECK(client.requests != nullptr);
+
+        client.requests->head.store(client.ringCapacity * 16, std::memory_order_release);
+        eventfd_write(client.serverDoorbell, 1);
+        CHECK(waitFor(server, PipeClientData::Kind::Disconnected, id));
+        CHECK(closedByServer(client));
+        close(client.socketFd);
+    }
+
+    // A response ring whose tail overtook its head, found when the server writes
+    {
+        PipeClientId id = 0;
+        TestClient client = connectClient(server, socketPath, id);
+        CHECK(client.responses != nullptr);
+
+        client.responses->tail.store(1, std::memory_order_release);
+        server.writeData(id, {std::make_shared<const std::string>("response")});
+        CHECK(waitFor(server, PipeClientData::Kind::Disconnected, id));
+        CHECK(closedByServer(client));
+        close(client.socketFd);
+    }
+
+    // Shrinking the shared memory would make the server's next ring access fault
+    {
+        PipeClientId id = 0;
+        TestClient client = connectClient(server, socketPath, id);
+        CHECK(client.memoryFd != -1);
+
+        CHECK(ftruncate(client.memoryFd, 0) == -1 && errno == EPERM);
+        CHECK(ftruncate(client.memoryFd, 1 << 30) == -1 && errno == EPERM);
+        server.writeData(id, {std::make_shared<const std::string>("response")});
+        CHECK(client.responses->head.load(std::memory_order_acquire) == std::strlen("response"));
+        close(client.memoryFd);
+        close(client.socketFd);
+        CHECK(waitFor(server, PipeClientData::Kind::Disconnected, id));
+    }
+
+    // The server keeps serving well-behaved clients, and reports the one it closes
+    {
+        PipeClientId id = 0;
+        TestClient client = connectClient(server, socketPath, id);
+        CHECK(client.requests != nullptr);
+
+        server.closeClient(id);
+        CHECK(waitFor(server, PipeClientData::Kind::Disconnected, id));
+        CHECK(closedByServer(client));
+        close(client.socketFd);
+    }
+
+    server.stop();
+    return TEST_RESULT();
+}
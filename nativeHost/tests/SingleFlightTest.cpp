@@ -0,0 +1,47 @@
+// Requests with the same key share one execution and get the very same response,
+// serialized once; a request with another key, e.g. made after the state it reads
+// changed, starts its own
+
+#include "SingleFlight.h"
+#include "TestCheck.hpp"
+
+#include <memory>
+#include <vector>
+
+using json = nlohmann::json;
+
+int main() {
+    TimerWheel timers;
+    SingleFlight singleFlight(timers);
+
+    std::vector<SingleFlight::Reply> executions;
+    auto work = [&executions](const std::shared_ptr<RequestContext>&, SingleFlight::Reply done) {
+        executions.push_back(std::move(done));
+    };
+    std::vector<SharedMessagePtr> replies(3);
+    auto replyTo = [&replies](size_t index) {
+        return [&replies, index](SharedMessagePtr response) { replies[index] = std::move(response); };
+    };
+
+    singleFlight.run("tabInfo", "tabInfo@1", std::make_shared<RequestContext>(), replyTo(0), work);
+    singleFlight.run("tabInfo", "tabInfo@1", std::make_shared<RequestContext>(), replyTo(1), work);
+    singleFlight.run("tabInfo", "tabInfo@2", std::make_shared<RequestContext>(), replyTo(2), work);
+    CHECK(executions.size() == 2);
+    CHECK(singleFlight.statistics().joined == 1);
+    CHECK(singleFlight.statistics().inFlight == 2);
+
+    if (executions.size() == 2) {
+        executions[0](makeSharedMessage(json{{"data", "old tab"}}));
+        executions[1](makeSharedMessage(json{{"data", "new tab"}}));
+    }
+    CHECK(replies[0] && replies[0]->value().value("data", "") == "old tab");
+    CHECK(replies[1] == replies[0]);
+    CHECK(replies[2] && replies[2]->value().value("data", "") == "new tab");
+    if (replies[0] && replies[1]) {
+        CHECK(replies[0]->payload(PipeEncoding::Json) == replies[1]->payload(PipeEncoding::Json));
+        CHECK(*replies[0]->payload(PipeEncoding::Json) == R"({"data":"old tab"})");
+    }
+    CHECK(singleFlight.statistics().inFlight == 0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,20 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <iostream>
+
+// Minimal assertions for the test executables `meson test` runs: a failed CHECK
+// is reported with its location and makes TEST_RESULT() non-zero
+inline int testFailures = 0;
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n";  \
+            ++testFailures;                                                                  \
+        }                                                                                    \
+    } while (false)
+
+#define TEST_RESULT() (testFailures == 0 ? 0 : 1)
+
+#endif  // TEST_CHECK_H
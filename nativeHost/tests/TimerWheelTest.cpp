@@ -0,0 +1,49 @@
+// A timer never fires before its deadline, including deadlines that fall between
+// ticks and ones that start out on an outer wheel, and fires within a tick after it
+
+#include "TimerWheel.h"
+#include "TestCheck.hpp"
+
+#include <chrono>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+int main() {
+    auto start = TimerWheel::Clock::now();
+    TimerWheel timers(start);
+
+    // Deadlines a fraction of a tick past a tick boundary, on every level
+    std::vector<TimerWheel::Clock::duration> delays = {100us, 999us, 1ms, 1500us, 63ms + 1us, 64ms + 700us,
+                                                       4095ms + 1us, 4096ms + 300us, 5000ms + 999us};
+    std::vector<TimerWheel::Clock::time_point> firedAt(delays.size());
+    auto now = start;
+    for (size_t i = 0; i < delays.size(); ++i) {
+        timers.schedule(start + delays[i], [&firedAt, &now, i] { firedAt[i] = now; });
+    }
+
+    // A cancelled timer never fires
+    bool cancelledFired = false;
+    CHECK(timers.cancel(timers.schedule(start + 2ms, [&cancelledFired] { cancelledFired = true; })));
+
+    auto step = 100us;
+    for (now = start; now <= start + 5002ms; now += step) {
+        timers.advance(now);
+    }
+
+    for (size_t i = 0; i < delays.size(); ++i) {
+        auto deadline = start + delays[i];
+        CHECK(firedAt[i] >= deadline);
+        CHECK(firedAt[i] < deadline + 1ms + step);
+    }
+    CHECK(!cancelledFired);
+    CHECK(timers.size() == 0);
+
+    // Deadlines already in the past fire on the next tick
+    bool overdueFired = false;
+    timers.schedule(start, [&overdueFired] { overdueFired = true; });
+    CHECK(timers.advance(now + 1ms) == 1);
+    CHECK(overdueFired);
+
+    return TEST_RESULT();
+}